@@ -32,14 +32,70 @@
 #include "list.h"
 #include "log.h"
 #include "screen.h"
+#include "stack.h"
+#include "stats.h"
+#include "trace.h"
 #include "util.h"
+#include "xalloc.h"
 
-// Client tracking information
+// Number of clients allocated at a time by client_alloc()
+#define CLIENT_SLAB_SIZE 32
+
+// Clients are allocated from slabs which are never freed; released slots go on
+// a free list for reuse.  Hot client data is kept contiguous, with the cold
+// metadata in a separate array in the same slab.  Each slot also has the MRU
+// links it needs if it is ever fixed, so fixing a client doesn't allocate.
+struct client_slab {
+	struct client clients[CLIENT_SLAB_SIZE];
+	struct client_meta meta[CLIENT_SLAB_SIZE];
+	struct mru_link mru_fixed[];  // option.vdesks per slot
+};
+
+static struct client *client_free_list = NULL;
+
+// Client tracking information.  Alt+Tab order is kept per vdesk in each
+// screen's MRU rings; clients_tab_order is now just a list of all clients.
 struct list *clients_tab_order = NULL;
-struct list *clients_mapping_order = NULL;
-struct list *clients_stacking_order = NULL;
 struct client *current = NULL;
 
+// Allocate a zeroed client, with its metadata attached.  Returns NULL if
+// allocation fails.
+
+struct client *client_alloc(void) {
+	if (!client_free_list) {
+		void *mem;
+		// Align so that each client occupies its own cache line.
+		size_t size = sizeof(struct client_slab)
+			+ CLIENT_SLAB_SIZE * option.vdesks * sizeof(struct mru_link);
+		if (posix_memalign(&mem, 64, size) != 0)
+			return NULL;
+		STATS_ALLOC(size);
+		struct client_slab *slab = mem;
+		for (int i = CLIENT_SLAB_SIZE - 1; i >= 0; i--) {
+			slab->clients[i].meta = &slab->meta[i];
+			slab->meta[i].mru_fixed = &slab->mru_fixed[i * option.vdesks];
+			slab->meta[i].next_free = client_free_list;
+			client_free_list = &slab->clients[i];
+		}
+	}
+	struct client *c = client_free_list;
+	struct client_meta *meta = c->meta;
+	struct mru_link *mru_fixed = meta->mru_fixed;
+	client_free_list = meta->next_free;
+	memset(c, 0, sizeof(*c));
+	memset(meta, 0, sizeof(*meta));
+	c->meta = meta;
+	meta->mru_fixed = mru_fixed;
+	return c;
+}
+
+// Return a client to the free list.
+
+void client_free(struct client *c) {
+	c->meta->next_free = client_free_list;
+	client_free_list = c;
+}
+
 // Get WM_NORMAL_HINTS property.  Populates appropriate parts of the client
 // structure and returns the hint flags (which indicates whether sizes or
 // positions were user- or program-specified).
@@ -50,58 +106,61 @@ long get_wm_normal_hints(struct client *c) {
 	XSizeHints *size = XAllocSizeHints();
 
 	LOG_XENTER("XGetWMNormalHints(window=%lx)", (unsigned long)c->window);
+	TRACE_BEGIN(TRACE_XGETWMNORMALHINTS, 0);
 	XGetWMNormalHints(display.dpy, c->window, size, &dummy);
+	TRACE_END(TRACE_XGETWMNORMALHINTS);
 	debug_wm_normal_hints(size);
 	LOG_XLEAVE();
 
 	flags = size->flags;
 
 	if (flags & PMinSize) {
-		c->min_width = size->min_width;
-		c->min_height = size->min_height;
+		c->meta->min_width = size->min_width;
+		c->meta->min_height = size->min_height;
 	} else {
-		c->min_width = c->min_height = 0;
+		c->meta->min_width = c->meta->min_height = 0;
 	}
 
 	if (flags & PMaxSize) {
-		c->max_width = size->max_width;
-		c->max_height = size->max_height;
+		c->meta->max_width = size->max_width;
+		c->meta->max_height = size->max_height;
 	} else {
-		c->max_width = c->max_height = 0;
+		c->meta->max_width = c->meta->max_height = 0;
 	}
 
 	if (flags & PBaseSize) {
-		c->base_width = size->base_width;
-		c->base_height = size->base_height;
+		c->meta->base_width = size->base_width;
+		c->meta->base_height = size->base_height;
 	} else {
-		c->base_width = c->min_width;
-		c->base_height = c->min_height;
+		c->meta->base_width = c->meta->min_width;
+		c->meta->base_height = c->meta->min_height;
 	}
 
-	c->width_inc = c->height_inc = 1;
+	c->meta->width_inc = c->meta->height_inc = 1;
 	if (flags & PResizeInc) {
-		c->width_inc = size->width_inc ? size->width_inc : 1;
-		c->height_inc = size->height_inc ? size->height_inc : 1;
+		c->meta->width_inc = size->width_inc ? size->width_inc : 1;
+		c->meta->height_inc = size->height_inc ? size->height_inc : 1;
 	}
 
 	if (!(flags & PMinSize)) {
-		c->min_width = c->base_width + c->width_inc;
-		c->min_height = c->base_height + c->height_inc;
+		c->meta->min_width = c->meta->base_width + c->meta->width_inc;
+		c->meta->min_height = c->meta->base_height + c->meta->height_inc;
 	}
 
 	if (flags & PWinGravity) {
-		c->win_gravity_hint = size->win_gravity;
+		c->meta->win_gravity_hint = size->win_gravity;
 	} else {
-		c->win_gravity_hint = NorthWestGravity;
+		c->meta->win_gravity_hint = NorthWestGravity;
 	}
-	c->win_gravity = c->win_gravity_hint;
+	c->meta->win_gravity = c->meta->win_gravity_hint;
 
 	XFree(size);
 	return flags;
 }
 
 // Determine EWMH "window type" and update client flags accordingly.  The only
-// windows we currently treat any differently are docks.
+// windows we currently treat any differently are docks, and notifications,
+// which are kept above normal windows along with docks.
 
 void get_window_type(struct client *c) {
 	unsigned type = ewmh_get_net_wm_window_type(c->window);
@@ -110,6 +169,20 @@ void get_window_type(struct client *c) {
 
 void update_window_type_flags(struct client *c, unsigned type) {
 	c->is_dock = (type & EWMH_WINDOW_TYPE_DOCK) ? 1 : 0;
+	c->is_notification = (type & EWMH_WINDOW_TYPE_NOTIFICATION) ? 1 : 0;
+}
+
+// Read WM_TRANSIENT_FOR, which puts a client in the transient group of
+// another (see client_group_leader()).
+
+void get_transient_for(struct client *c) {
+	Window w = None;
+	TRACE_BEGIN(TRACE_XGETTRANSIENTFORHINT, 0);
+	if (!XGetTransientForHint(display.dpy, c->window, &w))
+		w = None;
+	TRACE_END(TRACE_XGETTRANSIENTFORHINT);
+	c->meta->transient_for = w;
+	c->screen->groups_stale = 1;
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -229,22 +302,126 @@ void client_show(struct client *c) {
 	set_wm_state(c, NormalState);
 }
 
-// Raise client.  Maintains clients_stacking_order list and EWMH hints.
+// Transient groups.  Following WM_TRANSIENT_FOR from any client leads to the
+// group leader (usually an application's main window); the group is the
+// leader plus every client that leads to it.  Groups are raised and moved
+// between vdesks together.
+
+// Limit on WM_TRANSIENT_FOR links followed, in case of loops
+#define MAX_TRANSIENT_DEPTH 8
+
+struct client *client_group_leader(struct client *c) {
+	for (int i = 0; i < MAX_TRANSIENT_DEPTH && c->meta->transient_for != None; i++) {
+		struct client *t = find_client(c->meta->transient_for);
+		if (!t || t == c || t->screen != c->screen)
+			break;
+		c = t;
+	}
+	return c;
+}
+
+// Buffer for the members of a group, grown as needed
+static struct client **group = NULL;
+static unsigned group_size = 0;
+
+// Resolve and cache every client's group leader, and count each leader's
+// transients.  Only done after something that could change a group, so
+// raises don't follow WM_TRANSIENT_FOR through find_client() each time.
+
+static void resolve_groups(struct screen *s) {
+	for (unsigned i = 0; i < s->nstack; i++) {
+		struct client *c = s->stack[i];
+		c->meta->leader = client_group_leader(c);
+		c->meta->ntransients = 0;
+	}
+	for (unsigned i = 0; i < s->nstack; i++) {
+		struct client *c = s->stack[i];
+		if (c->meta->leader != c)
+			c->meta->leader->meta->ntransients++;
+	}
+	s->groups_stale = 0;
+}
+
+// Collect a client's transient group into group[]: the leader first, then
+// the rest in stacking order (bottom to top).  Returns the number of members.
+
+static unsigned collect_group(struct client *c) {
+	struct screen *s = c->screen;
+	if (s->groups_stale)
+		resolve_groups(s);
+	struct client *leader = c->meta->leader;
+	// Not yet in the stacking order, so not part of any group
+	if (!leader)
+		leader = c;
+	unsigned want = leader->meta->ntransients + 1;
+	if (want > group_size) {
+		group_size = s->nstack + 1;
+		group = xrealloc(group, group_size * sizeof(*group));
+		STATS_ALLOC(group_size * sizeof(*group));
+	}
+	unsigned n = 0;
+	group[n++] = leader;
+	for (unsigned i = 0; n < want && i < s->nstack; i++) {
+		struct client *ci = s->stack[i];
+		if (ci != leader && ci->meta->leader == leader)
+			group[n++] = ci;
+	}
+	return n;
+}
+
+// Raise client along with its transient group, keeping dialogs above their
+// main window and putting the client itself on top if it is one of the
+// dialogs.  Members in other layers are left alone.  Maintains the screen's
+// stacking order and EWMH hints.  Does nothing if the order wouldn't change.
 
 void client_raise(struct client *c) {
-	XRaiseWindow(display.dpy, c->parent);
-	clients_stacking_order = list_to_tail(clients_stacking_order, c);
+	unsigned n = collect_group(c);
+	int is_leader = (group[0] == c);
+	unsigned k = is_leader ? 1 : 0;
+	for (unsigned i = k; i < n; i++) {
+		if (group[i] != c && group[i]->layer == c->layer)
+			group[k++] = group[i];
+	}
+	if (!is_leader)
+		group[k++] = c;
+	if (!stack_raise_group(c->screen, group, k))
+		return;
+	TRACE_POINT(TRACE_RAISE, c->window, 0, 0);
 	ewmh_set_net_client_list_stacking(c->screen);
 }
 
-// Lower client.  Maintains clients_stacking_order list and EWMH hints.
+// Lower client.  Maintains the screen's stacking order and EWMH hints.  Does
+// nothing if the client is already at the bottom.
 
 void client_lower(struct client *c) {
-	XLowerWindow(display.dpy, c->parent);
-	clients_stacking_order = list_to_head(clients_stacking_order, c);
+	if (!stack_lower(c))
+		return;
+	TRACE_POINT(TRACE_LOWER, c->window, 0, 0);
 	ewmh_set_net_client_list_stacking(c->screen);
 }
 
+// Add, remove or toggle _NET_WM_STATE_ABOVE (or _NET_WM_STATE_BELOW if
+// 'below' is set).  The two are exclusive, so setting one clears the other.
+
+void client_set_layer(struct client *c, int action, int below) {
+	int was = below ? c->is_below : c->is_above;
+	int set = (action == NET_WM_STATE_TOGGLE) ? !was : (action == NET_WM_STATE_ADD);
+	if (set == was)
+		return;
+	if (below) {
+		c->is_below = set;
+		if (set)
+			c->is_above = 0;
+	} else {
+		c->is_above = set;
+		if (set)
+			c->is_below = 0;
+	}
+	ewmh_set_net_wm_state(c);
+	if (stack_relayer(c))
+		ewmh_set_net_client_list_stacking(c->screen);
+}
+
 // Set window state.  This is either NormalState (visible), IconicState
 // (hidden) or WithdrawnState (removing).
 
@@ -282,7 +459,7 @@ void send_config(struct client *c) {
 
 void client_gravitate(struct client *c, int bw) {
 	int dx = 0, dy = 0;
-	switch (c->win_gravity) {
+	switch (c->meta->win_gravity) {
 	default:
 	case NorthWestGravity:
 		dx = bw;
@@ -328,44 +505,182 @@ void client_gravitate(struct client *c, int bw) {
 // Activate a client.  Colours its border (and uncolours the
 // previously-selected), installs any colourmap, sets input focus and updates
 // EWMH properties.
+//
+// Only requests that change something are made, so re-selecting the current
+// client costs just the XSetInputFocus().
 
 void select_client(struct client *c) {
 	struct client *old_current = current;
-	if (current)
-		XSetWindowBorder(display.dpy, current->parent, current->screen->bg.pixel);
+	TRACE_POINT(TRACE_SELECT, c ? c->window : None, 0, 0);
+	current = c;
+	// Any focus change waiting for the pointer to settle is superseded.
+	display.focus_pending = None;
+	if (old_current && old_current != c)
+		client_update_border(old_current);
 	if (c) {
-		unsigned long bpixel;
-		if (is_fixed(c))
-			bpixel = c->screen->fc.pixel;
-		else
-			bpixel = c->screen->fg.pixel;
-		XSetWindowBorder(display.dpy, c->parent, bpixel);
-		XInstallColormap(display.dpy, c->cmap);
+		client_update_border(c);
+		client_install_colormap(c);
 		XSetInputFocus(display.dpy, c->window, RevertToPointerRoot, CurrentTime);
 	}
-	current = c;
 	// Update _NET_WM_STATE_FOCUSED for old current and _NET_ACTIVE_WINDOW
 	// on its screen root.
-	if (old_current)
+	if (old_current && old_current != c) {
 		ewmh_set_net_wm_state(old_current);
+		if (old_current->is_fullscreen) {
+			// Only kept above docks while focused
+			if (stack_relayer(old_current))
+				ewmh_set_net_client_list_stacking(old_current->screen);
+			ewmh_flush_client_lists(old_current->screen);
+		}
+	}
 	// Now do same for new current.
-	if (c)
+	if (c) {
 		ewmh_set_net_wm_state(c);
+		if (c->is_fullscreen && stack_relayer(c))
+			ewmh_set_net_client_list_stacking(c->screen);
+	}
 }
 
-// Move a client to a specific vdesk.  If that means it should no longer be
-// visible, hide it.
+// Set a client's border colour, unless it's already that colour.
+
+static void set_border_pixel(struct client *c, unsigned long bpixel) {
+	if (bpixel != c->meta->border_pixel) {
+		XSetWindowBorder(display.dpy, c->parent, bpixel | c->meta->border_alpha);
+		c->meta->border_pixel = bpixel;
+	}
+}
+
+// Colour a client's border to show whether it is selected (and fixed).
+
+void client_update_border(struct client *c) {
+	client_highlight(c, c == current);
+}
+
+// Colour a client's border as if it were selected or not, without changing
+// focus.  Used to preview Alt+Tab candidates.
+
+void client_highlight(struct client *c, int on) {
+	if (!on)
+		set_border_pixel(c, c->screen->bg.pixel);
+	else if (is_fixed(c))
+		set_border_pixel(c, c->screen->fc.pixel);
+	else
+		set_border_pixel(c, c->screen->fg.pixel);
+}
+
+// Install a client's colourmap, unless it is already installed.
+
+void client_install_colormap(struct client *c) {
+	if (c->meta->cmap != c->screen->installed_cmap) {
+		XInstallColormap(display.dpy, c->meta->cmap);
+		c->screen->installed_cmap = c->meta->cmap;
+	}
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+// Each screen keeps a ring of clients per vdesk, most recently used first, so
+// Alt+Tab is a pointer hop rather than a search of every client.
+
+static struct mru_link *mru_link(struct client *c, unsigned v) {
+	return is_fixed(c) ? &c->meta->mru_fixed[v] : &c->meta->mru;
+}
+
+static void mru_push(struct client *c, unsigned v) {
+	struct client **head = &c->screen->mru[v];
+	struct mru_link *l = mru_link(c, v);
+	if (!*head) {
+		l->next = l->prev = c;
+	} else {
+		struct client *first = *head;
+		struct client *last = mru_link(first, v)->prev;
+		l->next = first;
+		l->prev = last;
+		mru_link(first, v)->prev = c;
+		mru_link(last, v)->next = c;
+	}
+	*head = c;
+}
+
+static void mru_unlink(struct client *c, unsigned v) {
+	struct client **head = &c->screen->mru[v];
+	struct mru_link *l = mru_link(c, v);
+	if (l->next == c) {
+		*head = NULL;
+		return;
+	}
+	mru_link(l->prev, v)->next = l->next;
+	mru_link(l->next, v)->prev = l->prev;
+	if (*head == c)
+		*head = l->next;
+}
+
+// Add a client to the ring for its vdesk (or all of them, if fixed), as most
+// recently used.
+
+void client_mru_insert(struct client *c) {
+	if (!is_fixed(c)) {
+		mru_push(c, c->vdesk);
+		return;
+	}
+	for (unsigned v = 0; v < option.vdesks; v++)
+		mru_push(c, v);
+}
+
+// Remove a client from its ring(s).  Must be called before changing its vdesk.
+
+void client_mru_remove(struct client *c) {
+	if (!is_fixed(c)) {
+		mru_unlink(c, c->vdesk);
+		return;
+	}
+	for (unsigned v = 0; v < option.vdesks; v++)
+		mru_unlink(c, v);
+}
+
+// The next (less recently used) or previous client in the ring for vdesk v.
+
+struct client *client_mru_next(struct client *c, unsigned v, int reverse) {
+	struct mru_link *l = mru_link(c, v);
+	return reverse ? l->prev : l->next;
+}
+
+// Mark a client as most recently used on the vdesk it's visible on.
+
+void client_mru_touch(struct client *c) {
+	unsigned v = is_fixed(c) ? c->screen->vdesk : c->vdesk;
+	if (c->screen->mru[v] == c)
+		return;
+	mru_unlink(c, v);
+	mru_push(c, v);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+// Move a client, along with its transient group, to a specific vdesk.  If
+// that means they should no longer be visible, hide them.
 
 void client_to_vdesk(struct client *c, unsigned vdesk) {
-	if (valid_vdesk(vdesk)) {
-		c->vdesk = vdesk;
-		if (c->vdesk == c->screen->vdesk || c->vdesk == VDESK_FIXED) {
-			client_show(c);
+	if (!valid_vdesk(vdesk))
+		return;
+	TRACE_POINT(TRACE_TO_VDESK, c->window, vdesk, 0);
+	unsigned n = collect_group(c);
+	int visible = (vdesk == c->screen->vdesk || vdesk == VDESK_FIXED);
+	for (unsigned i = 0; i < n; i++) {
+		struct client *ci = group[i];
+		if (ci->vdesk == vdesk)
+			continue;
+		client_mru_remove(ci);
+		ci->vdesk = vdesk;
+		client_mru_insert(ci);
+		if (visible) {
+			client_show(ci);
 		} else {
-			client_hide(c);
+			client_hide(ci);
 		}
-		ewmh_set_net_wm_desktop(c);
-		select_client(current);
+		ewmh_set_net_wm_desktop(ci);
+		// Fixed clients have a different border colour
+		client_update_border(ci);
 	}
 }
 
@@ -374,9 +689,15 @@ void client_to_vdesk(struct client *c, unsigned vdesk) {
 
 void remove_client(struct client *c) {
 	LOG_ENTER("remove_client(window=%lx, %s)", (unsigned long)c->window, c->remove ? "withdrawing" : "wm quitting");
+	TRACE_POINT(TRACE_REMOVE, c->window, c->remove, 0);
+	TRACE_BEGIN(TRACE_REMOVE, c->remove);
+
+	// In remote mode, errors arriving later for the requests made here are
+	// ignored by serial, instead of waiting for them with XSync().
+	unsigned long first_serial = NextRequest(display.dpy);
 
 	// Grab the server so any X errors are guaranteed to come from our actions.
-	XGrabServer(display.dpy);
+	grab_server();
 
 	// Flag to ignore any X errors we trigger.  The window may well already
 	// have been deleted from the server, so anything we try to do to it
@@ -407,15 +728,15 @@ void remove_client(struct client *c) {
 
 	// Undo the geometry changes applied when we managed the client
 	client_gravitate(c, -c->border);
-	client_gravitate(c, c->old_border);
-	c->x -= c->old_border;
-	c->y -= c->old_border;
+	client_gravitate(c, c->meta->old_border);
+	c->x -= c->meta->old_border;
+	c->y -= c->meta->old_border;
 
 	// Reparent window back to the root
 	XReparentWindow(display.dpy, c->window, c->screen->root, c->x, c->y);
 
 	// Restore any old border
-	XSetWindowBorderWidth(display.dpy, c->window, c->old_border);
+	XSetWindowBorderWidth(display.dpy, c->window, c->meta->old_border);
 
 	// Remove window from "save set": we are no longer its parent, so if we
 	// die now, the window should be fine.
@@ -425,11 +746,17 @@ void remove_client(struct client *c) {
 	if (c->parent) {
 		XDestroyWindow(display.dpy, c->parent);
 	}
+	if (c->meta->frame_cmap) {
+		XFreeColormap(display.dpy, c->meta->frame_cmap);
+	}
 
 	// Remove from the client lists
 	clients_tab_order = list_delete(clients_tab_order, c);
-	clients_mapping_order = list_delete(clients_mapping_order, c);
-	clients_stacking_order = list_delete(clients_stacking_order, c);
+	client_mru_remove(c);
+	ewmh_client_list_remove(c);
+	stack_remove(c);
+	// Cached leaders may point to it
+	c->screen->groups_stale = 1;
 
 	// If the wm is quitting, we'll remove the client list properties
 	// soon enough, otherwise, update them:
@@ -444,8 +771,10 @@ void remove_client(struct client *c) {
 		// Remove _NET_WM_STATE_FOCUSED from client window and
 		// _NET_ACTIVE_WINDOW from screen if necessary.
 		ewmh_set_net_wm_state(c);
+		if (c->remove && c->is_fullscreen)
+			ewmh_flush_client_lists(c->screen);
 	}
-	free(c);
+	client_free(c);
 
 #ifdef DEBUG
 	{
@@ -456,9 +785,16 @@ void remove_client(struct client *c) {
 	}
 #endif
 
-	XUngrabServer(display.dpy);
-	XSync(display.dpy, False);
+	ungrab_server();
+	if (option.remote) {
+		ignore_xerrors(first_serial, NextRequest(display.dpy) - 1);
+	} else {
+		TRACE_BEGIN(TRACE_XSYNC, 0);
+		XSync(display.dpy, False);
+		TRACE_END(TRACE_XSYNC);
+	}
 	ignore_xerror = 0;
+	TRACE_END(TRACE_REMOVE);
 	LOG_LEAVE();
 }
 
@@ -471,11 +807,15 @@ void send_wm_delete(struct client *c, int kill_client) {
 	int n;
 	Atom *protocols;
 
-	if (!kill_client && XGetWMProtocols(display.dpy, c->window, &protocols, &n)) {
-		for (int i = 0; i < n; i++)
-			if (protocols[i] == X_ATOM(WM_DELETE_WINDOW))
-				delete_supported = 1;
-		XFree(protocols);
+	if (!kill_client) {
+		TRACE_BEGIN(TRACE_XGETWMPROTOCOLS, 0);
+		if (XGetWMProtocols(display.dpy, c->window, &protocols, &n)) {
+			for (int i = 0; i < n; i++)
+				if (protocols[i] == X_ATOM(WM_DELETE_WINDOW))
+					delete_supported = 1;
+			XFree(protocols);
+		}
+		TRACE_END(TRACE_XGETWMPROTOCOLS);
 	}
 	if (delete_supported) {
 		XEvent ev = {
@@ -527,6 +867,8 @@ void set_shape(struct client *c) {
 #ifdef INFOBANNER
 
 void create_info_window(struct client *c) {
+        if (!display_font())
+                return;
         display.info_window = XCreateSimpleWindow(display.dpy, c->screen->root, -4, -4, 2, 2,
                         0, c->screen->fg.pixel, c->screen->fg.pixel);
         XMapRaised(display.dpy, display.info_window);
@@ -537,17 +879,17 @@ void update_info_window(struct client *c) {
         char *name;
         char buf[27];
         int namew, iwinx, iwiny, iwinw, iwinh;
-        int width_inc = c->width_inc, height_inc = c->height_inc;
+        int width_inc = c->meta->width_inc, height_inc = c->meta->height_inc;
 
         if (!display.info_window)
                 return;
-        snprintf(buf, sizeof(buf), "%dx%d+%d+%d", (c->width-c->base_width)/width_inc,
-                (c->height-c->base_height)/height_inc, c->x, c->y);
-        iwinw = XTextWidth(display.font, buf, strlen(buf)) + 2;
-        iwinh = display.font->max_bounds.ascent + display.font->max_bounds.descent;
+        snprintf(buf, sizeof(buf), "%dx%d+%d+%d", (c->width-c->meta->base_width)/width_inc,
+                (c->height-c->meta->base_height)/height_inc, c->x, c->y);
+        iwinw = display_text_width(buf, strlen(buf)) + 2;
+        iwinh = display.font_ascent + display.font_descent;
         XFetchName(display.dpy, c->window, &name);
         if (name) {
-                namew = XTextWidth(display.font, name, strlen(name));
+                namew = display_text_width(name, strlen(name));
                 if (namew > iwinw)
                         iwinw = namew + 2;
                 iwinh = iwinh * 2;
@@ -29,23 +29,70 @@ struct monitor;
 #define KEY_TO_VDESK(key) ((key) - XK_1)
 #define valid_vdesk(v) ((v) == VDESK_FIXED || (v) < option.vdesks)
 
+// Client data is split in two.  struct client holds what is read on every
+// event or in scans across all clients, and is laid out to fit one 64-byte
+// cache line (on LP64).  Everything else is in struct client_meta, reached
+// through c->meta.  Both are allocated from a slab by client_alloc().
+
+struct client_meta;
+
 struct client {
 	Window window;  // actual application window
 	Window parent;  // parent window that we control
 	struct screen *screen;  // screen this client is on
-	Colormap cmap;  // colourmap to install when focussed
+	struct client_meta *meta;  // less frequently used data
 
 	// Virtual desktop
 	unsigned vdesk;
 
+	// Geometry
+	int x, y, width, height;
+	int border;  // current border
+
 	// Sometimes unmap events occur that we know aren't the client
 	// disappearing, flagged here:
-	int ignore_unmap;
+	unsigned short ignore_unmap;
+
+	// Flag set when we need to remove client from management
+	unsigned remove : 1;
+
+	unsigned is_dock : 1;
+	unsigned is_notification : 1;
+
+	// Fullscreen (see client_fullscreen()).  A kiosk window (see -kiosk)
+	// is fullscreen for good.
+	unsigned is_fullscreen : 1;
+	unsigned is_kiosk : 1;
+
+	// _NET_WM_STATE_ABOVE or _NET_WM_STATE_BELOW (see client_set_layer())
+	unsigned is_above : 1;
+	unsigned is_below : 1;
+
+	// Stacking layer, LAYER_* (see stack.h)
+	unsigned layer : 2;
+};
+
+// Keep it that way: anything else belongs in struct client_meta.
+_Static_assert(sizeof(struct client) <= 64, "struct client outgrew a cache line");
+
+// Links in a most-recently-used ring (see client_mru_touch())
+struct mru_link {
+	struct client *next, *prev;
+};
+
+struct client_meta {
+	Colormap cmap;  // colourmap to install when focussed
+
+	// The client window's visual and depth.  If these differ from the
+	// screen's default, the frame is created to match, with a colourmap
+	// of its own, and border pixels have any alpha bits added so that an
+	// ARGB frame's border is opaque (see reparent()).
+	Visual *visual;
+	int depth;
+	Colormap frame_cmap;
+	unsigned long border_alpha;
 
-	// Geometry
-	int x, y, width, height;
 	int normal_border;  // normal border when unmaximised
-	int border;  // current border
 
 	// Old geometry while maximising
 	int oldx, oldy, oldw, oldh;
@@ -53,12 +100,24 @@ struct client {
 	// Old border width - only used to restore when quitting
 	int old_border;
 
+	// Geometry and border to restore on leaving fullscreen
+	int fs_x, fs_y, fs_width, fs_height, fs_border;
+
+	// Border colour and _NET_WM_STATE as last set, so that unchanged
+	// values aren't sent again.  net_wm_state is a mask of the NET_WM_STATE_*
+	// bits in ewmh.c, or ~0 if never written.
+	unsigned long border_pixel;
+	unsigned net_wm_state;
+
+	// Position in the MRU ring for the client's vdesk.  A fixed client is
+	// in every vdesk's ring, so uses an array of links indexed by vdesk,
+	// set aside for it in the slab by client_alloc().
+	struct mru_link mru;
+	struct mru_link *mru_fixed;
+
 	// Old monitor offset as proportion of monitor geometry
 	double mon_offx, mon_offy;
 
-	// Flag set when we need to remove client from management
-	int remove;
-
 	// Various window metadata determined by examining properties
 	int min_width, min_height;
 	int max_width, max_height;
@@ -66,13 +125,23 @@ struct client {
 	int base_width, base_height;
 	int win_gravity_hint;
 	int win_gravity;
-	int is_dock;
+
+	// WM_TRANSIENT_FOR: the window this one is a dialog (etc.) for, or None
+	// (see client_group_leader())
+	Window transient_for;
+
+	// Cached group leader (the client itself if it has none) and, for a
+	// leader, the number of other clients in its group.  Resolved again
+	// when the screen's groups_stale is set.
+	struct client *leader;
+	unsigned ntransients;
+
+	// Next free slot while on the slab free list
+	struct client *next_free;
 };
 
 // Client tracking information
 extern struct list *clients_tab_order;
-extern struct list *clients_mapping_order;
-extern struct list *clients_stacking_order;
 extern struct client *current;
 
 #define is_fixed(c) (c->vdesk == VDESK_FIXED)
@@ -83,6 +152,7 @@ void client_manage_new(Window w, struct screen *s);
 long get_wm_normal_hints(struct client *c);
 void get_window_type(struct client *c);
 void update_window_type_flags(struct client *c, unsigned type);
+void get_transient_for(struct client *c);
 
 // client_move.c: user window manipulation
 
@@ -92,18 +162,32 @@ void client_show_info(struct client *c, unsigned keycode);
 void client_moveresize(struct client *c);
 void client_moveresizeraise(struct client *c);
 void client_maximise(struct client *c, int action, int hv);
-void client_select_next(void);
+void client_fullscreen(struct client *c, int action);
+struct client *client_find_next(struct client *from, int reverse);
+void client_select_next(int reverse);
+void client_activate(struct client *c);
 
 // client.c: various other client functions
 
+struct client *client_alloc(void);
+void client_free(struct client *c);
 struct client *find_client(Window w);
 struct monitor *client_monitor(struct client *c, Bool *intersects);
 void client_hide(struct client *c);
 void client_show(struct client *c);
 void client_raise(struct client *c);
 void client_lower(struct client *c);
+struct client *client_group_leader(struct client *c);
+void client_set_layer(struct client *c, int action, int below);
 void client_gravitate(struct client *c, int bw);
 void select_client(struct client *c);
+void client_update_border(struct client *c);
+void client_highlight(struct client *c, int on);
+void client_install_colormap(struct client *c);
+void client_mru_insert(struct client *c);
+void client_mru_remove(struct client *c);
+void client_mru_touch(struct client *c);
+struct client *client_mru_next(struct client *c, unsigned v, int reverse);
 void client_to_vdesk(struct client *c, unsigned vdesk);
 void remove_client(struct client *c);
 
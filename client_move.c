@@ -21,6 +21,8 @@
 #include "ewmh.h"
 #include "list.h"
 #include "screen.h"
+#include "stack.h"
+#include "trace.h"
 #include "util.h"
 
 #define SPACE 3
@@ -33,7 +35,7 @@
 static void draw_outline(struct client *c) {
 #ifndef INFOBANNER_MOVERESIZE
 	char buf[27];
-	int width_inc = c->width_inc, height_inc = c->height_inc;
+	int width_inc = c->meta->width_inc, height_inc = c->meta->height_inc;
 #endif
 
 	XDrawRectangle(display.dpy, c->screen->root, c->screen->invert_gc,
@@ -43,16 +45,18 @@ static void draw_outline(struct client *c) {
 #ifndef INFOBANNER_MOVERESIZE
 	if (width_inc > 1 || height_inc > 1) {
 		snprintf(buf, sizeof(buf), "%dx%d",
-			(c->width-c->base_width)/width_inc,
-			(c->height-c->base_height)/height_inc);
+			(c->width-c->meta->base_width)/width_inc,
+			(c->height-c->meta->base_height)/height_inc);
 	} else {
 		snprintf(buf, sizeof(buf), "%dx%d", c->width, c->height);
 	}
 
-	XDrawString(display.dpy, c->screen->root, c->screen->invert_gc,
-		c->x + c->width - XTextWidth(display.font, buf, strlen(buf)) - SPACE,
-		c->y + c->height - SPACE,
-		buf, strlen(buf));
+	if (display_font()) {
+		XDrawString(display.dpy, c->screen->root, c->screen->invert_gc,
+			c->x + c->width - display_text_width(buf, strlen(buf)) - SPACE,
+			c->y + c->height - SPACE,
+			buf, strlen(buf));
+	}
 #endif
 }
 
@@ -122,24 +126,24 @@ static void snap_client(struct client *c, struct monitor *monitor) {
 // based on mouse position relative to top-left corner.
 
 static void recalculate_sweep(struct client *c, int x1, int y1, int x2, int y2, _Bool force) {
-	if (force || c->oldw == 0) {
-		c->oldw = 0;
+	if (force || c->meta->oldw == 0) {
+		c->meta->oldw = 0;
 		c->width = abs(x1 - x2);
-		c->width -= (c->width - c->base_width) % c->width_inc;
-		if (c->min_width && c->width < c->min_width)
-			c->width = c->min_width;
-		if (c->max_width && c->width > c->max_width)
-			c->width = c->max_width;
+		c->width -= (c->width - c->meta->base_width) % c->meta->width_inc;
+		if (c->meta->min_width && c->width < c->meta->min_width)
+			c->width = c->meta->min_width;
+		if (c->meta->max_width && c->width > c->meta->max_width)
+			c->width = c->meta->max_width;
 		c->x = (x1 <= x2) ? x1 : x1 - c->width;
 	}
-	if (force || c->oldh == 0)  {
-		c->oldh = 0;
+	if (force || c->meta->oldh == 0)  {
+		c->meta->oldh = 0;
 		c->height = abs(y1 - y2);
-		c->height -= (c->height - c->base_height) % c->height_inc;
-		if (c->min_height && c->height < c->min_height)
-			c->height = c->min_height;
-		if (c->max_height && c->height > c->max_height)
-			c->height = c->max_height;
+		c->height -= (c->height - c->meta->base_height) % c->meta->height_inc;
+		if (c->meta->min_height && c->height < c->meta->min_height)
+			c->height = c->meta->min_height;
+		if (c->meta->max_height && c->height > c->meta->max_height)
+			c->height = c->meta->max_height;
 		c->y = (y1 <= y2) ? y1 : y1 - c->height;
 	}
 }
@@ -152,8 +156,14 @@ static void recalculate_sweep(struct client *c, int x1, int y1, int x2, int y2,
 // where available.
 
 void client_resize_sweep(struct client *c, unsigned button) {
+	if (c->is_fullscreen)
+		return;
+
 	// Ensure we can grab pointer events.
-	if (!grab_pointer(c->screen->root, display.resize_curs))
+	TRACE_BEGIN(TRACE_XGRABPOINTER, 0);
+	_Bool grabbed = grab_pointer(c->screen->root, display_resize_cursor());
+	TRACE_END(TRACE_XGRABPOINTER);
+	if (!grabbed)
 		return;
 
 	// Sweeping always raises.
@@ -165,7 +175,7 @@ void client_resize_sweep(struct client *c, unsigned button) {
 #ifdef INFOBANNER_MOVERESIZE
 	create_info_window(c);
 #endif
-	XGrabServer(display.dpy);
+	grab_server();
 	draw_outline(c);  // draw
 
 	// Warp pointer to the bottom-right of the client for resizing
@@ -178,26 +188,31 @@ void client_resize_sweep(struct client *c, unsigned button) {
 			case MotionNotify:
 				if (ev.xmotion.root != c->screen->root)
 					break;
+				TRACE_BEGIN(TRACE_MOTION, 0);
 				draw_outline(c);  // erase
-				XUngrabServer(display.dpy);
+				ungrab_server();
 				recalculate_sweep(c, old_cx, old_cy, ev.xmotion.x, ev.xmotion.y, ev.xmotion.state & altmask);
 #ifdef INFOBANNER_MOVERESIZE
 				update_info_window(c);
 #endif
+				TRACE_BEGIN(TRACE_XSYNC, 0);
 				XSync(display.dpy, False);
-				XGrabServer(display.dpy);
+				TRACE_END(TRACE_XSYNC);
+				grab_server();
 				draw_outline(c);  // draw
+				TRACE_END(TRACE_MOTION);
 				break;
 
 			case ButtonRelease:
 				if (ev.xbutton.button != button)
 					continue;
 				draw_outline(c);  // erase
-				XUngrabServer(display.dpy);
+				ungrab_server();
 #ifdef INFOBANNER_MOVERESIZE
 				remove_info_window();
 #endif
 				XUngrabPointer(display.dpy, CurrentTime);
+				TRACE_POINT(TRACE_SWEEP, c->window, c->width, c->height);
 				client_moveresizeraise(c);
 				// In case maximise state has changed:
 				ewmh_set_net_wm_state(c);
@@ -216,8 +231,14 @@ void client_resize_sweep(struct client *c, unsigned button) {
 // limitations as in the sweep() function.
 
 void client_move_drag(struct client *c, unsigned button) {
+	if (c->is_fullscreen)
+		return;
+
 	// Ensure we can grab pointer events.
-	if (!grab_pointer(c->screen->root, display.move_curs))
+	TRACE_BEGIN(TRACE_XGRABPOINTER, 0);
+	_Bool grabbed = grab_pointer(c->screen->root, display_move_cursor());
+	TRACE_END(TRACE_XGRABPOINTER);
+	if (!grabbed)
 		return;
 
 	// Dragging always raises.
@@ -236,7 +257,7 @@ void client_move_drag(struct client *c, unsigned button) {
 	create_info_window(c);
 #endif
 	if (option.no_solid_drag) {
-		XGrabServer(display.dpy);
+		grab_server();
 		draw_outline(c);  // draw
 	}
 
@@ -247,13 +268,14 @@ void client_move_drag(struct client *c, unsigned button) {
 			case MotionNotify:
 				if (ev.xmotion.root != c->screen->root)
 					break;
+				TRACE_BEGIN(TRACE_MOTION, 0);
 				if (option.no_solid_drag) {
 					draw_outline(c);  // erase
-					XUngrabServer(display.dpy);
+					ungrab_server();
 				}
-				if (c->oldw == 0)
+				if (c->meta->oldw == 0)
 					c->x = old_cx + (ev.xmotion.x - x1);
-				if (c->oldh == 0)
+				if (c->meta->oldh == 0)
 					c->y = old_cy + (ev.xmotion.y - y1);
 				if (option.snap && !(ev.xmotion.state & altmask))
 					snap_client(c, monitor);
@@ -262,8 +284,10 @@ void client_move_drag(struct client *c, unsigned button) {
 				update_info_window(c);
 #endif
 				if (option.no_solid_drag) {
+					TRACE_BEGIN(TRACE_XSYNC, 0);
 					XSync(display.dpy, False);
-					XGrabServer(display.dpy);
+					TRACE_END(TRACE_XSYNC);
+					grab_server();
 					draw_outline(c);  // draw
 				} else {
 					XMoveWindow(display.dpy, c->parent,
@@ -271,6 +295,7 @@ void client_move_drag(struct client *c, unsigned button) {
 							c->y - c->border);
 					send_config(c);
 				}
+				TRACE_END(TRACE_MOTION);
 				break;
 
 			case ButtonRelease:
@@ -278,12 +303,13 @@ void client_move_drag(struct client *c, unsigned button) {
 					continue;
 				if (option.no_solid_drag) {
 					draw_outline(c);  // erase
-					XUngrabServer(display.dpy);
+					ungrab_server();
 				}
 #ifdef INFOBANNER_MOVERESIZE
 				remove_info_window();
 #endif
 				XUngrabPointer(display.dpy, CurrentTime);
+				TRACE_POINT(TRACE_DRAG, c->window, c->x, c->y);
 				if (option.no_solid_drag) {
 					// For solid drags, the client was
 					// moved with the mouse.  For non-solid
@@ -323,13 +349,16 @@ static Bool predicate_keyrepeatpress(Display *dummy, XEvent *ev, XPointer arg) {
 // which indicates autorepeat.
 
 void client_show_info(struct client *c, unsigned keycode) {
-	if (XGrabKeyboard(display.dpy, c->screen->root, False, GrabModeAsync, GrabModeAsync, CurrentTime) != GrabSuccess)
+	TRACE_BEGIN(TRACE_XGRABKEYBOARD, 0);
+	int grab = XGrabKeyboard(display.dpy, c->screen->root, False, GrabModeAsync, GrabModeAsync, CurrentTime);
+	TRACE_END(TRACE_XGRABKEYBOARD);
+	if (grab != GrabSuccess)
 		return;
 
 #ifdef INFOBANNER
 	create_info_window(c);
 #else
-	XGrabServer(display.dpy);
+	grab_server();
 	draw_outline(c);
 #endif
 
@@ -349,7 +378,7 @@ void client_show_info(struct client *c, unsigned keycode) {
 	remove_info_window();
 #else
 	draw_outline(c);
-	XUngrabServer(display.dpy);
+	ungrab_server();
 #endif
 
 	XUngrabKeyboard(display.dpy, CurrentTime);
@@ -380,6 +409,16 @@ void client_maximise(struct client *c, int action, int hv) {
 	int monitor_x, monitor_y;
 	int monitor_width, monitor_height;
 
+	TRACE_POINT(TRACE_MAXIMISE, c->window, action, hv);
+
+	// A fullscreen client already fills its monitor.  Toggling maximise
+	// (the user's maximise keys) takes it out of fullscreen instead.
+	if (c->is_fullscreen) {
+		if (action == NET_WM_STATE_TOGGLE)
+			client_fullscreen(c, NET_WM_STATE_REMOVE);
+		return;
+	}
+
 	// Maximising to monitor or screen?
 	if (hv & MAXIMISE_SCREEN) {
 		monitor_x = monitor_y = 0;
@@ -394,22 +433,22 @@ void client_maximise(struct client *c, int action, int hv) {
 	}
 
 	if (hv & MAXIMISE_HORZ) {
-		if (c->oldw) {
+		if (c->meta->oldw) {
 			if (action == NET_WM_STATE_REMOVE || action == NET_WM_STATE_TOGGLE) {
-				c->x = c->oldx;
-				c->width = c->oldw;
-				c->oldw = 0;
+				c->x = c->meta->oldx;
+				c->width = c->meta->oldw;
+				c->meta->oldw = 0;
 				XDeleteProperty(display.dpy, c->window, X_ATOM(_EVILWM_UNMAXIMISED_HORZ));
 			}
 		} else {
 			if (action == NET_WM_STATE_ADD || action == NET_WM_STATE_TOGGLE) {
 				unsigned long props[2];
-				c->oldx = c->x;
-				c->oldw = c->width;
+				c->meta->oldx = c->x;
+				c->meta->oldw = c->width;
 				c->x = monitor_x;
 				c->width = monitor_width;
-				props[0] = c->oldx;
-				props[1] = c->oldw;
+				props[0] = c->meta->oldx;
+				props[1] = c->meta->oldw;
 				XChangeProperty(display.dpy, c->window, X_ATOM(_EVILWM_UNMAXIMISED_HORZ),
 						XA_CARDINAL, 32, PropModeReplace,
 						(unsigned char *)&props, 2);
@@ -417,22 +456,22 @@ void client_maximise(struct client *c, int action, int hv) {
 		}
 	}
 	if (hv & MAXIMISE_VERT) {
-		if (c->oldh) {
+		if (c->meta->oldh) {
 			if (action == NET_WM_STATE_REMOVE || action == NET_WM_STATE_TOGGLE) {
-				c->y = c->oldy;
-				c->height = c->oldh;
-				c->oldh = 0;
+				c->y = c->meta->oldy;
+				c->height = c->meta->oldh;
+				c->meta->oldh = 0;
 				XDeleteProperty(display.dpy, c->window, X_ATOM(_EVILWM_UNMAXIMISED_VERT));
 			}
 		} else {
 			if (action == NET_WM_STATE_ADD || action == NET_WM_STATE_TOGGLE) {
 				unsigned long props[2];
-				c->oldy = c->y;
-				c->oldh = c->height;
+				c->meta->oldy = c->y;
+				c->meta->oldh = c->height;
 				c->y = monitor_y;
 				c->height = monitor_height;
-				props[0] = c->oldy;
-				props[1] = c->oldh;
+				props[0] = c->meta->oldy;
+				props[1] = c->meta->oldh;
 				XChangeProperty(display.dpy, c->window, X_ATOM(_EVILWM_UNMAXIMISED_VERT),
 						XA_CARDINAL, 32, PropModeReplace,
 						(unsigned char *)&props, 2);
@@ -440,7 +479,7 @@ void client_maximise(struct client *c, int action, int hv) {
 		}
 	}
 	_Bool change_border = 0;
-	if (c->oldw && c->oldh) {
+	if (c->meta->oldw && c->meta->oldh) {
 		// maximised - remove border
 		if (c->border) {
 			c->border = 0;
@@ -448,8 +487,8 @@ void client_maximise(struct client *c, int action, int hv) {
 		}
 	} else {
 		// not maximised - add border
-		if (!c->border && c->normal_border) {
-			c->border = c->normal_border;
+		if (!c->border && c->meta->normal_border) {
+			c->border = c->meta->normal_border;
 			change_border = 1;
 		}
 	}
@@ -462,33 +501,102 @@ void client_maximise(struct client *c, int action, int hv) {
 	discard_enter_events(c);
 }
 
-// Find and select the "next" client, relative to the currently selected one
-// (basically, handle Alt+Tab).  Order is most-recently-used (maintained in the
-// clients_tab_order list).
+// Enter or leave fullscreen.  Unlike maximising in both directions, this
+// covers the whole monitor without a border regardless of hints, raises the
+// client, and while it has focus nothing underneath takes focus on pointer
+// entry and client list properties are left stale (see ewmh.c).
 
-void client_select_next(void) {
-	struct list *newl = list_find(clients_tab_order, current);
-	struct client *newc = current;
-
-	do {
-		if (newl) {
-			newl = newl->next;
-			if (!newl && !current)
-				return;
-		}
-		if (!newl)
-			newl = clients_tab_order;
-		if (!newl)
-			return;
-		newc = newl->data;
-		if (newc == current)
-			return;
-	} while ((!is_fixed(newc) && (newc->vdesk != newc->screen->vdesk))
-		 || (newc->is_dock && !newc->screen->docks_visible));
-
-	if (!newc)
+void client_fullscreen(struct client *c, int action) {
+	int fullscreen = (action == NET_WM_STATE_TOGGLE) ? !c->is_fullscreen : (action == NET_WM_STATE_ADD);
+	int old_border = c->border;
+	if (fullscreen == c->is_fullscreen || c->is_kiosk)
 		return;
 
+	TRACE_POINT(TRACE_MAXIMISE, c->window, action, MAXIMISE_HORZ|MAXIMISE_VERT);
+
+	if (fullscreen) {
+		struct monitor *monitor = client_monitor(c, NULL);
+		c->meta->fs_x = c->x;
+		c->meta->fs_y = c->y;
+		c->meta->fs_width = c->width;
+		c->meta->fs_height = c->height;
+		c->meta->fs_border = c->border;
+		c->x = monitor->x;
+		c->y = monitor->y;
+		c->width = monitor->width;
+		c->height = monitor->height;
+		c->border = 0;
+	} else {
+		c->x = c->meta->fs_x;
+		c->y = c->meta->fs_y;
+		c->width = c->meta->fs_width;
+		c->height = c->meta->fs_height;
+		c->border = c->meta->fs_border;
+	}
+	c->is_fullscreen = fullscreen;
+	if (stack_relayer(c))
+		ewmh_set_net_client_list_stacking(c->screen);
+
+	if (c->border != old_border) {
+		XSetWindowBorderWidth(display.dpy, c->parent, c->border);
+		ewmh_set_net_frame_extents(c->window, c->border);
+	}
+	ewmh_set_net_wm_state(c);
+	if (fullscreen) {
+		client_moveresizeraise(c);
+	} else {
+		client_moveresize(c);
+		ewmh_flush_client_lists(c->screen);
+	}
+	discard_enter_events(c);
+}
+
+// Find the "next" client after 'from' (or the current one, if NULL), or the
+// previous one if 'reverse' is set.  Order is most-recently-used, from the
+// current vdesk's ring (see client.c).  Returns NULL if there is no other
+// candidate.
+
+struct client *client_find_next(struct client *from, int reverse) {
+	if (!from)
+		from = current;
+	struct screen *s = from ? from->screen : find_current_screen();
+	unsigned v = s->vdesk;
+	struct client *head = s->mru[v];
+	struct client *start = NULL;
+	struct client *newc;
+
+	if (!head)
+		return NULL;
+	// Start from 'from' if it's in this ring
+	if (from && (is_fixed(from) || from->vdesk == v))
+		start = from;
+
+	struct client *stop = start ? start : head;
+	newc = start ? client_mru_next(start, v, reverse) : head;
+	// Skip hidden docks
+	while (newc->is_dock && !s->docks_visible) {
+		newc = client_mru_next(newc, v, reverse);
+		if (newc == stop)
+			return NULL;
+	}
+	if (newc == from)
+		return NULL;
+	return newc;
+}
+
+// Select the next client (see client_find_next()).  The MRU ring isn't
+// reordered here: the caller calls client_mru_touch() once the user has
+// settled on a client.
+
+void client_select_next(int reverse) {
+	struct client *newc = client_find_next(NULL, reverse);
+	if (newc)
+		client_activate(newc);
+}
+
+// Show, raise and select a client chosen with Alt+Tab.
+
+void client_activate(struct client *newc) {
 	client_show(newc);  // XXX why would it be hidden?
 	client_raise(newc);
 	select_client(newc);
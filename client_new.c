@@ -28,9 +28,15 @@
 #include "list.h"
 #include "log.h"
 #include "screen.h"
+#include "stack.h"
+#include "trace.h"
 #include "util.h"
 
-static void init_geometry(struct client *c);
+static int app_matches(struct application *a, XClassHint *class);
+static void init_geometry(struct client *c, struct application *kiosk);
+static struct monitor *kiosk_monitor(struct client *c, struct application *a, int x, int y);
+static void apply_app_geometry(struct client *c, struct application *a);
+static void place_new(struct client *c, XWindowAttributes *attr, long size_flags);
 static void reparent(struct client *c);
 
 // client_manage_new is called when a map request event for an unmanaged window
@@ -38,13 +44,16 @@ static void reparent(struct client *c);
 
 void client_manage_new(Window w, struct screen *s) {
 	struct client *c;
-	char *name;
 	XClassHint *class;
-	unsigned window_type;
+	unsigned window_type, wm_state;
+	struct application *kiosk = NULL;
 
 	LOG_ENTER("client_manage_new(window=%lx)", (unsigned long)w);
+	TRACE_POINT(TRACE_MANAGE, w, s->screen, 0);
+	TRACE_BEGIN(TRACE_MANAGE, s->screen);
+	STATS_MANAGE_BEGIN();
 
-	XGrabServer(display.dpy);
+	grab_server();
 
 	// First a bit of interaction with the error handler due to X's
 	// tendency to batch event notifications.  We set a global variable to
@@ -53,48 +62,64 @@ void client_manage_new(Window w, struct screen *s) {
 	// do so as we've grabbed the server), the error handler resets the
 	// variable indicating the window has already disappeared, so we stop
 	// trying to manage it.
+	//
+	// XGetGeometry() is used as it is a single round trip, and the error
+	// (if any) is handled before it returns.
 
 	initialising = w;
-	XFetchName(display.dpy, w, &name);
-	XSync(display.dpy, False);
+	{
+		Window root;
+		int x, y;
+		unsigned width, height, bw, depth;
+		TRACE_BEGIN(TRACE_XGETGEOMETRY, 0);
+		XGetGeometry(display.dpy, w, &root, &x, &y, &width, &height, &bw, &depth);
+		TRACE_END(TRACE_XGETGEOMETRY);
+	}
 
 	// If 'initialising' is now set to None, that means doing the
-	// XFetchName raised BadWindow - the window has been removed before
+	// XGetGeometry raised BadWindow - the window has been removed before
 	// we got a chance to grab the server. */
 
 	if (initialising == None) {
 		LOG_DEBUG("XError occurred for initialising window - aborting...\n");
-		XUngrabServer(display.dpy);
+		ungrab_server();
+		TRACE_END(TRACE_MANAGE);
 		LOG_LEAVE();
 		return;
 	}
 	initialising = None;
 	LOG_DEBUG("screen=%d\n", s->screen);
-	LOG_DEBUG("name=%s\n", name ? name : "Untitled");
-	if (name)
-		XFree(name);
+#ifdef DEBUG
+	{
+		char *name;
+		XFetchName(display.dpy, w, &name);
+		LOG_DEBUG("name=%s\n", name ? name : "Untitled");
+		if (name)
+			XFree(name);
+	}
+#endif
 
 	window_type = ewmh_get_net_wm_window_type(w);
 	// Don't manage DESKTOP type windows
 	if (window_type & EWMH_WINDOW_TYPE_DESKTOP) {
 		XMapWindow(display.dpy, w);
-		XUngrabServer(display.dpy);
+		ungrab_server();
+		TRACE_END(TRACE_MANAGE);
 		return;
 	}
 
 	// If allocation fails, don't crash the window manager.  Just don't
 	// manage the window.
-	c = malloc(sizeof(struct client));
+	c = client_alloc();
 	if (!c) {
 		LOG_ERROR("out of memory allocating new client\n");
 		XMapWindow(display.dpy, w);
-		XUngrabServer(display.dpy);
+		ungrab_server();
+		TRACE_END(TRACE_MANAGE);
 		LOG_LEAVE();
 		return;
 	}
 	clients_tab_order = list_prepend(clients_tab_order, c);
-	clients_mapping_order = list_append(clients_mapping_order, c);
-	clients_stacking_order = list_append(clients_stacking_order, c);
 
 	c->screen = s;
 	c->window = w;
@@ -102,15 +127,45 @@ void client_manage_new(Window w, struct screen *s) {
 	c->remove = 0;
 
 	// Ungrab the X server as soon as possible. Now that the client is
-	// malloc()ed and attached to the list, it is safe for any subsequent
+	// allocated and attached to the list, it is safe for any subsequent
 	// X calls to raise an X error and thus flag it for removal.
 
-	XUngrabServer(display.dpy);
+	ungrab_server();
 
-	c->normal_border = option.bw;
+	c->meta->normal_border = option.bw;
+	c->meta->net_wm_state = ~0u;
+
+	// Read name/class information for client.  This is checked against
+	// the list built with -app options; in kiosk mode, the first match
+	// decides the window's geometry up front.
+	class = XAllocClassHint();
+	if (class) {
+		TRACE_BEGIN(TRACE_XGETCLASSHINT, 0);
+		XGetClassHint(display.dpy, w, class);
+		TRACE_END(TRACE_XGETCLASSHINT);
+		if (option.kiosk) {
+			for (struct list *iter = applications; iter; iter = iter->next) {
+				if (app_matches(iter->data, class)) {
+					kiosk = iter->data;
+					break;
+				}
+			}
+		}
+	}
 
 	update_window_type_flags(c, window_type);
-	init_geometry(c);
+	wm_state = ewmh_get_net_wm_state(w);
+	c->is_above = (wm_state & EWMH_WM_STATE_ABOVE) ? 1 : 0;
+	c->is_below = (wm_state & EWMH_WM_STATE_BELOW) ? 1 : 0;
+	init_geometry(c, kiosk);
+
+	// A transient starts out on the same vdesk as the rest of its group.
+	get_transient_for(c);
+	if (c->meta->transient_for != None) {
+		struct client *leader = client_group_leader(c);
+		if (leader != c)
+			c->vdesk = leader->vdesk;
+	}
 
 #ifdef DEBUG
 	{
@@ -121,7 +176,8 @@ void client_manage_new(Window w, struct screen *s) {
 	}
 #endif
 
-	XSelectInput(display.dpy, c->window, ColormapChangeMask | EnterWindowMask | PropertyChangeMask);
+	XSelectInput(display.dpy, c->window, ColormapChangeMask | PropertyChangeMask
+	             | (POINTER_CONTROL ? EnterWindowMask : 0));
 
 	reparent(c);
 
@@ -132,39 +188,16 @@ void client_manage_new(Window w, struct screen *s) {
 	}
 #endif
 
-	// Read name/class information for client and check against list built
-	// with -app options.
-	class = XAllocClassHint();
+	// Apply any -app options that match.
 	if (class) {
-		XGetClassHint(display.dpy, w, class);
 		for (struct list *iter = applications; iter; iter = iter->next) {
 			struct application *a = iter->data;
-			// Does resource name and class match?
-			if ((!a->res_name || (class->res_name && !strcmp(class->res_name, a->res_name)))
-					&& (!a->res_class || (class->res_class && !strcmp(class->res_class, a->res_class)))) {
-
-				// Override width or height?
-				if (a->geometry_mask & WidthValue)
-					c->width = a->width * c->width_inc;
-				if (a->geometry_mask & HeightValue)
-					c->height = a->height * c->height_inc;
-
-				// Override X or Y?
-				if (a->geometry_mask & XValue) {
-					if (a->geometry_mask & XNegative)
-						c->x = a->x + DisplayWidth(display.dpy, s->screen)-c->width-c->border;
-					else
-						c->x = a->x + c->border;
-				}
-				if (a->geometry_mask & YValue) {
-					if (a->geometry_mask & YNegative)
-						c->y = a->y + DisplayHeight(display.dpy, s->screen)-c->height-c->border;
-					else
-						c->y = a->y + c->border;
-				}
+			if (app_matches(a, class)) {
 
-				// XXX better way of updating window geometry?
-				client_moveresizeraise(c);
+				// Override geometry?  Kiosk windows are already in
+				// place.
+				if (!kiosk)
+					apply_app_geometry(c, a);
 
 				// Force treating this app as a dock?
 				if (a->is_dock)
@@ -180,10 +213,21 @@ void client_manage_new(Window w, struct screen *s) {
 		XFree(class);
 	}
 
+	// Now that its vdesk is settled, it can join the Alt+Tab ring(s).
+	if (!valid_vdesk(c->vdesk))
+		c->vdesk = s->vdesk;
+	client_mru_insert(c);
+
+	// And with its layer settled, it can join the stacking order, and
+	// any transient group.
+	stack_add(c);
+	s->groups_stale = 1;
+
 	// Set EWMH property on client advertising WM features
 	ewmh_set_allowed_actions(c);
 
 	// Update EWMH client list hints for screen
+	ewmh_client_list_add(c);
 	ewmh_set_net_client_list(c->screen);
 	ewmh_set_net_client_list_stacking(c->screen);
 
@@ -192,10 +236,17 @@ void client_manage_new(Window w, struct screen *s) {
 	// IconicState (hidden).
 	if (is_fixed(c) || c->vdesk == s->vdesk) {
 		client_show(c);
-		client_raise(c);
+		// A new frame is created on top, so a kiosk window needn't
+		// be raised again.
+		if (!kiosk)
+			client_raise(c);
 		// Don't focus windows that aren't on the same display as the
-		// pointer.
-		if (get_pointer_root_xy(c->window, NULL, NULL) &&
+		// pointer.  When headless, the pointer is irrelevant: always
+		// focus, so that tests see the same result every time.
+		if (option.headless) {
+			if (!(window_type & (EWMH_WINDOW_TYPE_DOCK|EWMH_WINDOW_TYPE_NOTIFICATION)))
+				select_client(c);
+		} else if (get_pointer_root_xy(c->window, NULL, NULL) &&
 		    !(window_type & (EWMH_WINDOW_TYPE_DOCK|EWMH_WINDOW_TYPE_NOTIFICATION))) {
 			select_client(c);
 #ifdef WARP_POINTER
@@ -211,12 +262,28 @@ void client_manage_new(Window w, struct screen *s) {
 	// Ensure whichever vdesk it ended up on is reflected in the EWMH hints
 	ewmh_set_net_wm_desktop(c);
 
+	// Selecting a client writes its _NET_WM_STATE.  A kiosk window that
+	// wasn't selected must still advertise that it is fullscreen.
+	if (kiosk && c != current)
+		ewmh_set_net_wm_state(c);
+
+	STATS_MANAGE_END();
+	TRACE_END(TRACE_MANAGE);
 	LOG_LEAVE();
 }
 
-// Fetches various hints to determine a window's initial geometry.
+// Does an -app option's resource name and class match a window's?
 
-static void init_geometry(struct client *c) {
+static int app_matches(struct application *a, XClassHint *class) {
+	return (!a->res_name || (class->res_name && !strcmp(class->res_name, a->res_name)))
+	       && (!a->res_class || (class->res_class && !strcmp(class->res_class, a->res_class)));
+}
+
+// Fetches various hints to determine a window's initial geometry.  If 'kiosk'
+// is set, the window is instead placed directly at its final geometry: the
+// whole of the monitor it is assigned to, without a border.
+
+static void init_geometry(struct client *c, struct application *kiosk) {
 	unsigned long nitems;
 	XWindowAttributes attr;
 
@@ -228,7 +295,7 @@ static void init_geometry(struct client *c) {
 				&& (mprop->flags & MWM_HINTS_DECORATIONS)
 				&& !(mprop->decorations & MWM_DECOR_ALL)
 				&& !(mprop->decorations & MWM_DECOR_BORDER)) {
-			c->normal_border = 0;
+			c->meta->normal_border = 0;
 		}
 		XFree(mprop);
 	}
@@ -245,22 +312,22 @@ static void init_geometry(struct client *c) {
 		XFree(lprop);
 	}
 
-	// Check EWMH properties for window type.  We treat some windows (e.g.,
-	// docks) differently).
-	get_window_type(c);
-
 	// Get current window attributes
 	LOG_XENTER("XGetWindowAttributes(window=%lx)", (unsigned long)c->window);
+	TRACE_BEGIN(TRACE_XGETWINDOWATTRIBUTES, 0);
 	XGetWindowAttributes(display.dpy, c->window, &attr);
+	TRACE_END(TRACE_XGETWINDOWATTRIBUTES);
 	debug_window_attributes(&attr);
 	LOG_XLEAVE();
 	// We remove any client border, so preserve its old value to restore on
 	// emulator quit.
-	c->old_border = attr.border_width;
-	c->cmap = attr.colormap;
+	c->meta->old_border = attr.border_width;
+	c->meta->cmap = attr.colormap;
+	c->meta->visual = attr.visual;
+	c->meta->depth = attr.depth;
 
 	// Default to no unmaximised width/height.
-	c->oldw = c->oldh = 0;
+	c->meta->oldw = c->meta->oldh = 0;
 
 	// If the _EVILWM_UNMAXIMISED_HORZ is present, it was previously
 	// managed by evilwm and this property contains the unmaximised X
@@ -269,8 +336,8 @@ static void init_geometry(struct client *c) {
 	unsigned long *eprop;
 	if ( (eprop = get_property(c->window, X_ATOM(_EVILWM_UNMAXIMISED_HORZ), XA_CARDINAL, &nitems)) ) {
 		if (nitems == 2) {
-			c->oldx = eprop[0];
-			c->oldw = eprop[1];
+			c->meta->oldx = eprop[0];
+			c->meta->oldw = eprop[1];
 		}
 		XFree(eprop);
 	}
@@ -279,29 +346,74 @@ static void init_geometry(struct client *c) {
 	// coordinate and height.
 	if ( (eprop = get_property(c->window, X_ATOM(_EVILWM_UNMAXIMISED_VERT), XA_CARDINAL, &nitems)) ) {
 		if (nitems == 2) {
-			c->oldy = eprop[0];
-			c->oldh = eprop[1];
+			c->meta->oldy = eprop[0];
+			c->meta->oldh = eprop[1];
 		}
 		XFree(eprop);
 	}
 
-	c->border = (c->oldw && c->oldh) ? 0 : c->normal_border;
+	c->border = (c->meta->oldw && c->meta->oldh) ? 0 : c->meta->normal_border;
 
 	// Update some client info from the WM_NORMAL_HINTS property.  The
 	// flags returned will indicate whether certain values were user- or
 	// program-specified.
 	long size_flags = get_wm_normal_hints(c);
 
+	if (kiosk) {
+		struct monitor *m = kiosk_monitor(c, kiosk, attr.x, attr.y);
+		c->meta->normal_border = c->border = 0;
+		c->x = m->x;
+		c->y = m->y;
+		c->width = m->width;
+		c->height = m->height;
+		// It stays that way: there's nothing to restore.
+		c->meta->fs_x = c->x;
+		c->meta->fs_y = c->y;
+		c->meta->fs_width = c->width;
+		c->meta->fs_height = c->height;
+		c->meta->fs_border = 0;
+		c->is_fullscreen = 1;
+		c->is_kiosk = 1;
+	} else {
+		place_new(c, &attr, size_flags);
+	}
+
+	ewmh_set_net_frame_extents(c->window, c->border);
+
+	LOG_DEBUG("window started as %dx%d +%d+%d\n", c->width, c->height, c->x, c->y);
+
+	// If the window was already viewable (existed while window manager
+	// starts), that means the reparent to come would send an unmap request
+	// to the root window.  Set a flag to ignore this.
+	if (attr.map_state == IsViewable) {
+		c->ignore_unmap++;
+	}
+
+	if (kiosk)
+		return;
+
+	// Account for removed old_border
+	c->x += c->meta->old_border;
+	c->y += c->meta->old_border;
+	client_gravitate(c, -c->meta->old_border);
+	client_gravitate(c, c->border);
+}
+
+// Position a new (non-kiosk) window: at its current position if it was already
+// visible or the position was user-specified, else relative to the pointer.
+// Size is taken from the window unless it's below the hinted minimum.
+
+static void place_new(struct client *c, XWindowAttributes *attr, long size_flags) {
 	_Bool need_send_config = 0;
 
 	// If the current window dimensions conform to the minimums specified
 	// in WM_NORMAL_HINTS, use them.  Otherwise, use the mimimums.
-	if ((attr.width >= c->min_width) && (attr.height >= c->min_height)) {
-		c->width = attr.width;
-		c->height = attr.height;
+	if ((attr->width >= c->meta->min_width) && (attr->height >= c->meta->min_height)) {
+		c->width = attr->width;
+		c->height = attr->height;
 	} else {
-		c->width = c->min_width;
-		c->height = c->min_height;
+		c->width = c->meta->min_width;
+		c->height = c->meta->min_height;
 		need_send_config = 1;
 	}
 
@@ -313,9 +425,9 @@ static void init_geometry(struct client *c) {
 	// XXX: if an existing window would be mapped off the screen, would it
 	// be sensible to move it somewhere visible?
 
-	if ((attr.map_state == IsViewable) || (size_flags & USPosition)) {
-		c->x = attr.x;
-		c->y = attr.y;
+	if ((attr->map_state == IsViewable) || (size_flags & USPosition)) {
+		c->x = attr->x;
+		c->y = attr->y;
 	} else {
 		int xmax = DisplayWidth(display.dpy, c->screen->screen);
 		int ymax = DisplayHeight(display.dpy, c->screen->screen);
@@ -328,23 +440,54 @@ static void init_geometry(struct client *c) {
 
 	if (need_send_config)
 		send_config(c);
+}
 
-	ewmh_set_net_frame_extents(c->window, c->border);
+// Apply the geometry given with an -app option.
 
-	LOG_DEBUG("window started as %dx%d +%d+%d\n", c->width, c->height, c->x, c->y);
+static void apply_app_geometry(struct client *c, struct application *a) {
+	struct screen *s = c->screen;
 
-	// If the window was already viewable (existed while window manager
-	// starts), that means the reparent to come would send an unmap request
-	// to the root window.  Set a flag to ignore this.
-	if (attr.map_state == IsViewable) {
-		c->ignore_unmap++;
+	// Override width or height?
+	if (a->geometry_mask & WidthValue)
+		c->width = a->width * c->meta->width_inc;
+	if (a->geometry_mask & HeightValue)
+		c->height = a->height * c->meta->height_inc;
+
+	// Override X or Y?
+	if (a->geometry_mask & XValue) {
+		if (a->geometry_mask & XNegative)
+			c->x = a->x + DisplayWidth(display.dpy, s->screen)-c->width-c->border;
+		else
+			c->x = a->x + c->border;
+	}
+	if (a->geometry_mask & YValue) {
+		if (a->geometry_mask & YNegative)
+			c->y = a->y + DisplayHeight(display.dpy, s->screen)-c->height-c->border;
+		else
+			c->y = a->y + c->border;
 	}
 
-	// Account for removed old_border
-	c->x += c->old_border;
-	c->y += c->old_border;
-	client_gravitate(c, -c->old_border);
-	client_gravitate(c, c->border);
+	// XXX better way of updating window geometry?
+	client_moveresizeraise(c);
+}
+
+// Choose the monitor for a kiosk window: the one containing the position
+// given with -g, if any, otherwise the one containing the window's requested
+// position, otherwise the first.  Doesn't query the pointer.
+
+static struct monitor *kiosk_monitor(struct client *c, struct application *a, int x, int y) {
+	if (a->geometry_mask & XValue) {
+		x = (a->geometry_mask & XNegative) ? DisplayWidth(display.dpy, c->screen->screen) + a->x : a->x;
+	}
+	if (a->geometry_mask & YValue) {
+		y = (a->geometry_mask & YNegative) ? DisplayHeight(display.dpy, c->screen->screen) + a->y : a->y;
+	}
+	for (int i = 0; i < c->screen->nmonitors; i++) {
+		struct monitor *m = &c->screen->monitors[i];
+		if (x >= m->x && x < m->x + m->width && y >= m->y && y < m->y + m->height)
+			return m;
+	}
+	return &c->screen->monitors[0];
 }
 
 // Wraps XGrabButton() to grab button presses on a window with or without
@@ -369,23 +512,57 @@ static void grab_button(unsigned button, unsigned modifiers, Window w) {
 
 // Create parent window for a client and reparent.
 
+// Decide whether a frame can use the client's own visual.  Only TrueColor
+// visuals whose colour channels match the default's qualify, so that the
+// screen's allocated pixel values mean the same thing in either.  Anything
+// else gets a default frame, as before.
+
+static int frame_matches_client(struct client *c) {
+	Visual *dv = DefaultVisual(display.dpy, c->screen->screen);
+	Visual *v = c->meta->visual;
+	if (!v || v == dv)
+		return 0;
+	return v->class == TrueColor && dv->class == TrueColor
+	       && v->red_mask == dv->red_mask && v->green_mask == dv->green_mask
+	       && v->blue_mask == dv->blue_mask;
+}
+
 static void reparent(struct client *c) {
 	XSetWindowAttributes p_attr;
+	unsigned long p_mask = CWOverrideRedirect | CWBorderPixel | CWEventMask;
+	int depth = DefaultDepth(display.dpy, c->screen->screen);
+	Visual *visual = DefaultVisual(display.dpy, c->screen->screen);
+
+	// A frame matching an ARGB (or other non-default) client saves the
+	// server converting between depths whenever the client is drawn.
+	if (frame_matches_client(c)) {
+		Visual *v = c->meta->visual;
+		unsigned long all = (c->meta->depth >= 32) ? 0xffffffffUL : (1UL << c->meta->depth) - 1;
+		depth = c->meta->depth;
+		visual = v;
+		c->meta->frame_cmap = XCreateColormap(display.dpy, c->screen->root, v, AllocNone);
+		c->meta->border_alpha = all & ~(v->red_mask | v->green_mask | v->blue_mask);
+		p_attr.colormap = c->meta->frame_cmap;
+		p_mask |= CWColormap;
+	}
 
 	// Default border is unselected (bg)
-	p_attr.border_pixel = c->screen->bg.pixel;
+	p_attr.border_pixel = c->screen->bg.pixel | c->meta->border_alpha;
+	c->meta->border_pixel = c->screen->bg.pixel;
 	// We want to handle events for this parent window
 	p_attr.override_redirect = True;
 	// The events we need to manage the window
 	p_attr.event_mask = SubstructureRedirectMask | SubstructureNotifyMask
-	                    | ButtonPressMask | EnterWindowMask;
+	                    | ButtonPressMask;
+	// Focus doesn't follow the pointer on a headless display or in kiosk
+	// mode
+	if (POINTER_CONTROL)
+		p_attr.event_mask |= EnterWindowMask;
 
 	// Create parent window, accounting for border width
 	c->parent = XCreateWindow(display.dpy, c->screen->root, c->x-c->border, c->y-c->border,
-		c->width, c->height, c->border,
-		DefaultDepth(display.dpy, c->screen->screen), CopyFromParent,
-		DefaultVisual(display.dpy, c->screen->screen),
-		CWOverrideRedirect | CWBorderPixel | CWEventMask, &p_attr);
+		c->width, c->height, c->border, depth, CopyFromParent, visual,
+		p_mask, &p_attr);
 
 	// Adding the original window to our "save set" means that if we die
 	// unexpectedly, the window will be reparented back to the root.
@@ -394,13 +571,23 @@ static void reparent(struct client *c) {
 	// Kill any internal border on the application window
 	XSetWindowBorderWidth(display.dpy, c->window, 0);
 
+	// A kiosk window has been given the size of its monitor, but so far
+	// only the frame has been created that size.
+	if (c->is_kiosk) {
+		XResizeWindow(display.dpy, c->window, c->width, c->height);
+		send_config(c);
+	}
+
 	// Reparent into our new parent window
 	XReparentWindow(display.dpy, c->window, c->parent, 0, 0);
 
 	// Map the window (shows up within parent)
 	XMapWindow(display.dpy, c->window);
 
-	// Grab mouse button actions on the parent window
-	grab_button(AnyButton, grabmask2, c->parent);
-	grab_button(AnyButton, grabmask2|altmask, c->parent);
+	// Grab mouse button actions on the parent window.  Nobody is there to
+	// press them on a headless display, and kiosk windows can't be moved.
+	if (POINTER_CONTROL) {
+		grab_button(AnyButton, grabmask2, c->parent);
+		grab_button(AnyButton, grabmask2|altmask, c->parent);
+	}
 }
@@ -0,0 +1,451 @@
+/* evilwm - minimalist window manager for X11
+ * Copyright (C) 1999-2021 Ciaran Anscomb <evilwm@6809.org.uk>
+ * see README for license and other details. */
+
+// Control socket.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef CONTROL
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <X11/X.h>
+#include <X11/Xlib.h>
+
+#include "client.h"
+#include "control.h"
+#include "display.h"
+#include "events.h"
+#include "evilwm.h"
+#include "list.h"
+#include "log.h"
+#include "screen.h"
+#include "termpool.h"
+#include "util.h"
+#include "xalloc.h"
+
+// Longest command line accepted.  Anything longer is discarded up to the next
+// newline.
+#define CONTROL_LINE_MAX 128
+
+// Number of connections served at once.  Further connections wait in the
+// listen backlog until one closes.
+#define CONTROL_CONNECTIONS_MAX 16
+
+// Number of parsed commands that may be waiting for the main thread.  Must be
+// a power of two.
+#define CONTROL_QUEUE_SIZE 64
+
+enum control_op {
+	CONTROL_VDESK,
+	CONTROL_PREVDESK,
+	CONTROL_NEXTDESK,
+	CONTROL_TOGGLEDESK,
+	CONTROL_NEXT,
+	CONTROL_FIX,
+	CONTROL_MAX,
+	CONTROL_MAXVERT,
+	CONTROL_MAXHORZ,
+	CONTROL_RAISE,
+	CONTROL_LOWER,
+	CONTROL_CLOSE,
+	CONTROL_KILL,
+	CONTROL_DOCKS,
+	CONTROL_TERM,
+	CONTROL_QUIT,
+};
+
+struct control_cmd {
+	enum control_op op;
+	unsigned long arg;
+};
+
+// Recognised commands.  Those flagged as taking an argument require a
+// numeric value.
+static const struct {
+	const char *name;
+	enum control_op op;
+	int has_arg;
+} control_commands[] = {
+	{ "vdesk",      CONTROL_VDESK,      1 },
+	{ "prevdesk",   CONTROL_PREVDESK,   0 },
+	{ "nextdesk",   CONTROL_NEXTDESK,   0 },
+	{ "toggledesk", CONTROL_TOGGLEDESK, 0 },
+	{ "next",       CONTROL_NEXT,       0 },
+	{ "fix",        CONTROL_FIX,        0 },
+	{ "max",        CONTROL_MAX,        0 },
+	{ "maxvert",    CONTROL_MAXVERT,    0 },
+	{ "maxhorz",    CONTROL_MAXHORZ,    0 },
+	{ "raise",      CONTROL_RAISE,      0 },
+	{ "lower",      CONTROL_LOWER,      0 },
+	{ "close",      CONTROL_CLOSE,      0 },
+	{ "kill",       CONTROL_KILL,       0 },
+	{ "docks",      CONTROL_DOCKS,      0 },
+	{ "term",       CONTROL_TERM,       0 },
+	{ "quit",       CONTROL_QUIT,       0 },
+};
+#define NUM_CONTROL_COMMANDS (int)(sizeof(control_commands) / sizeof(control_commands[0]))
+
+static char *socket_path = NULL;
+static int listen_fd = -1;
+
+// Written to by the control thread after queueing a command, so that the
+// main thread's select() wakes up.
+static int wake_pipe[2] = { -1, -1 };
+
+// Lock-free command queue.  Only the control thread writes queue_tail, and
+// only the main thread writes queue_head.
+static struct control_cmd queue[CONTROL_QUEUE_SIZE];
+static unsigned queue_head = 0;
+static unsigned queue_tail = 0;
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+// Control thread side
+
+// Add a command to the queue and wake the main thread.  If the queue is full,
+// this thread waits: the main thread never does.
+
+static void queue_push(const struct control_cmd *cmd) {
+	unsigned tail = __atomic_load_n(&queue_tail, __ATOMIC_RELAXED);
+	while (tail - __atomic_load_n(&queue_head, __ATOMIC_ACQUIRE) >= CONTROL_QUEUE_SIZE) {
+		struct timespec ts = { 0, 1000000 };
+		nanosleep(&ts, NULL);
+	}
+	queue[tail % CONTROL_QUEUE_SIZE] = *cmd;
+	__atomic_store_n(&queue_tail, tail + 1, __ATOMIC_RELEASE);
+
+	// If the pipe is already full, the main thread is due to wake anyway.
+	ssize_t r = write(wake_pipe[1], "", 1);
+	(void)r;
+}
+
+// Parse one line into a command and queue it.  Unrecognised lines are
+// ignored.
+
+static void parse_line(char *line) {
+	char *saveptr;
+	char *name = strtok_r(line, " \t\r", &saveptr);
+	if (!name)
+		return;
+	for (int i = 0; i < NUM_CONTROL_COMMANDS; i++) {
+		if (strcmp(control_commands[i].name, name) != 0)
+			continue;
+		struct control_cmd cmd = { .op = control_commands[i].op, .arg = 0 };
+		if (control_commands[i].has_arg) {
+			char *arg = strtok_r(NULL, " \t\r", &saveptr);
+			char *end;
+			if (!arg)
+				return;
+			cmd.arg = strtoul(arg, &end, 0);
+			if (*end)
+				return;
+		}
+		queue_push(&cmd);
+		return;
+	}
+}
+
+// An open connection, and any partial line read from it
+struct connection {
+	char buf[CONTROL_LINE_MAX];
+	size_t len;
+	int discard;
+};
+
+static struct connection connections[CONTROL_CONNECTIONS_MAX];
+
+// Read whatever is available on a connection and parse any complete lines.
+// Returns zero once the connection is closed.
+
+static int read_commands(int fd, struct connection *conn) {
+	ssize_t n = read(fd, conn->buf + conn->len, sizeof(conn->buf) - conn->len);
+	if (n < 0 && (errno == EINTR || errno == EAGAIN))
+		return 1;
+	if (n <= 0) {
+		// Accept a final command lacking a newline
+		if (conn->len > 0 && !conn->discard) {
+			conn->buf[conn->len] = 0;
+			parse_line(conn->buf);
+		}
+		return 0;
+	}
+	size_t end = conn->len + n;
+	size_t start = 0;
+	for (size_t i = conn->len; i < end; i++) {
+		if (conn->buf[i] == '\n') {
+			conn->buf[i] = 0;
+			if (!conn->discard)
+				parse_line(conn->buf + start);
+			conn->discard = 0;
+			start = i + 1;
+		}
+	}
+	conn->len = end - start;
+	memmove(conn->buf, conn->buf + start, conn->len);
+	if (conn->len == sizeof(conn->buf)) {
+		conn->discard = 1;
+		conn->len = 0;
+	}
+	return 1;
+}
+
+// Serve the listening socket and every open connection together, so that a
+// client that connects and sends nothing doesn't hold up anyone else.  The
+// first poll entry is the listening socket, which isn't polled while all
+// connection slots are in use.
+
+static void *control_thread(void *arg) {
+	struct pollfd fds[CONTROL_CONNECTIONS_MAX + 1];
+	int nconns = 0;
+	(void)arg;
+
+	fds[0].fd = listen_fd;
+	fds[0].events = POLLIN;
+	for (;;) {
+		fds[0].fd = (nconns < CONTROL_CONNECTIONS_MAX) ? listen_fd : -1;
+		if (poll(fds, nconns + 1, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		for (int i = 0; i < nconns; i++) {
+			if (!fds[i + 1].revents)
+				continue;
+			if (read_commands(fds[i + 1].fd, &connections[i]))
+				continue;
+			// Closed: move the last connection into this slot
+			close(fds[i + 1].fd);
+			nconns--;
+			fds[i + 1] = fds[nconns + 1];
+			connections[i] = connections[nconns];
+			i--;
+		}
+		if (fds[0].fd >= 0 && (fds[0].revents & POLLIN)) {
+			int fd = accept(listen_fd, NULL, NULL);
+			if (fd < 0) {
+				if (errno == EINTR || errno == ECONNABORTED || errno == EAGAIN)
+					continue;
+				break;
+			}
+			fcntl(fd, F_SETFD, FD_CLOEXEC);
+			fcntl(fd, F_SETFL, O_NONBLOCK);
+			fds[nconns + 1].fd = fd;
+			fds[nconns + 1].events = POLLIN;
+			fds[nconns + 1].revents = 0;
+			connections[nconns].len = 0;
+			connections[nconns].discard = 0;
+			nconns++;
+		}
+	}
+	return NULL;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+// Main thread side
+
+static int queue_pop(struct control_cmd *cmd) {
+	unsigned head = __atomic_load_n(&queue_head, __ATOMIC_RELAXED);
+	if (head == __atomic_load_n(&queue_tail, __ATOMIC_ACQUIRE))
+		return 0;
+	*cmd = queue[head % CONTROL_QUEUE_SIZE];
+	__atomic_store_n(&queue_head, head + 1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+static void do_command(const struct control_cmd *cmd) {
+	struct screen *s = find_current_screen();
+	struct client *c = current;
+
+	if (!s)
+		s = &display.screens[0];
+
+	switch (cmd->op) {
+	case CONTROL_VDESK:
+		if (cmd->arg <= VDESK_MAX)
+			switch_vdesk(s, cmd->arg);
+		return;
+	case CONTROL_PREVDESK:
+		if (s->vdesk > 0)
+			switch_vdesk(s, s->vdesk - 1);
+		return;
+	case CONTROL_NEXTDESK:
+		if (s->vdesk < VDESK_MAX)
+			switch_vdesk(s, s->vdesk + 1);
+		return;
+	case CONTROL_TOGGLEDESK:
+		switch_vdesk(s, s->old_vdesk);
+		return;
+	case CONTROL_NEXT:
+		client_select_next(0);
+		if (current)
+			client_mru_touch(current);
+		return;
+	case CONTROL_DOCKS:
+		set_docks_visible(s, !s->docks_visible);
+		return;
+	case CONTROL_TERM:
+#ifdef TERMPOOL
+		if (termpool_take(s))
+			return;
+#endif
+		spawn((const char *const *)option.term);
+		return;
+	case CONTROL_QUIT:
+		wm_exit = 1;
+		return;
+	default:
+		break;
+	}
+
+	// Remaining commands act on the current client
+	if (!c)
+		return;
+
+	switch (cmd->op) {
+	case CONTROL_FIX:
+		client_to_vdesk(c, is_fixed(c) ? c->screen->vdesk : VDESK_FIXED);
+		break;
+	case CONTROL_MAX:
+		client_maximise(c, NET_WM_STATE_TOGGLE, MAXIMISE_HORZ|MAXIMISE_VERT);
+		break;
+	case CONTROL_MAXVERT:
+		client_maximise(c, NET_WM_STATE_TOGGLE, MAXIMISE_VERT);
+		break;
+	case CONTROL_MAXHORZ:
+		client_maximise(c, NET_WM_STATE_TOGGLE, MAXIMISE_HORZ);
+		break;
+	case CONTROL_RAISE:
+		client_raise(c);
+		break;
+	case CONTROL_LOWER:
+		client_lower(c);
+		break;
+	case CONTROL_CLOSE:
+		send_wm_delete(c, 0);
+		break;
+	case CONTROL_KILL:
+		send_wm_delete(c, 1);
+		break;
+	default:
+		break;
+	}
+}
+
+// Called from the event loop when the control thread has queued commands.
+
+static void handle_control_wakeup(int fd) {
+	char buf[64];
+	struct control_cmd cmd;
+	while (read(fd, buf, sizeof(buf)) > 0)
+		;
+	while (queue_pop(&cmd))
+		do_command(&cmd);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+// Create the control socket and start the thread serving it.
+
+int control_open(const char *path) {
+	struct sockaddr_un addr;
+	struct stat st;
+	pthread_t thread;
+	sigset_t all_signals, old_signals;
+
+	LOG_ENTER("control_open(path=%s)", path);
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		LOG_ERROR("control socket path too long: %s\n", path);
+		LOG_LEAVE();
+		return 0;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	// Remove a stale socket left by a previous run, but nothing else
+	if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+		unlink(path);
+
+	listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listen_fd < 0) {
+		LOG_ERROR("control socket: %s\n", strerror(errno));
+		LOG_LEAVE();
+		return 0;
+	}
+	fcntl(listen_fd, F_SETFD, FD_CLOEXEC);
+
+	// Only the user running evilwm may connect
+	mode_t old_umask = umask(077);
+	int rc = bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr));
+	umask(old_umask);
+	if (rc < 0 || listen(listen_fd, 4) < 0) {
+		LOG_ERROR("control socket %s: %s\n", path, strerror(errno));
+		close(listen_fd);
+		listen_fd = -1;
+		LOG_LEAVE();
+		return 0;
+	}
+	socket_path = xstrdup(path);
+
+	if (pipe(wake_pipe) < 0) {
+		LOG_ERROR("control socket: %s\n", strerror(errno));
+		control_close();
+		LOG_LEAVE();
+		return 0;
+	}
+	for (int i = 0; i < 2; i++) {
+		fcntl(wake_pipe[i], F_SETFD, FD_CLOEXEC);
+		fcntl(wake_pipe[i], F_SETFL, O_NONBLOCK);
+	}
+	watch_fd(wake_pipe[0], handle_control_wakeup);
+
+	// Signals must continue to be delivered to the main thread, where
+	// they interrupt the event loop.  The new thread inherits this mask.
+	sigfillset(&all_signals);
+	pthread_sigmask(SIG_SETMASK, &all_signals, &old_signals);
+	rc = pthread_create(&thread, NULL, control_thread, NULL);
+	pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+	if (rc != 0) {
+		LOG_ERROR("control socket: can't create thread\n");
+		control_close();
+		LOG_LEAVE();
+		return 0;
+	}
+	pthread_detach(thread);
+
+	LOG_LEAVE();
+	return 1;
+}
+
+// Remove the control socket.  The control thread is left blocked in poll();
+// it only ever touches its own connections and the queue, and is discarded
+// when the process exits.
+
+void control_close(void) {
+	if (wake_pipe[0] >= 0)
+		unwatch_fd(wake_pipe[0]);
+	if (socket_path) {
+		unlink(socket_path);
+		free(socket_path);
+		socket_path = NULL;
+	}
+}
+
+#endif
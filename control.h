@@ -0,0 +1,26 @@
+/* evilwm - minimalist window manager for X11
+ * Copyright (C) 1999-2021 Ciaran Anscomb <evilwm@6809.org.uk>
+ * see README for license and other details. */
+
+// Control socket.
+//
+// Scripts may connect to a Unix domain socket and send simple line-based
+// commands (e.g., "vdesk 2").  Connections are accepted and parsed on a
+// separate thread, so a slow or misbehaving client can never stall window
+// management.  Parsed commands are passed to the main thread through a
+// single-producer, single-consumer queue, and only the main thread ever
+// touches the display or the client lists.
+
+#ifndef EVILWM_CONTROL_H_
+#define EVILWM_CONTROL_H_
+
+// Create the control socket and start the thread serving it.  Returns
+// non-zero on success.
+
+int control_open(const char *path);
+
+// Remove the control socket.
+
+void control_close(void);
+
+#endif
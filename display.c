@@ -9,8 +9,11 @@
 #endif
 
 #include <assert.h>
+#include <fcntl.h>
+#include <setjmp.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <X11/X.h>
 #include <X11/Xlib.h>
@@ -28,17 +31,45 @@
 
 #include "client.h"
 #include "display.h"
+#include "events.h"
 #include "evilwm.h"
 #include "ewmh.h"
 #include "list.h"
 #include "log.h"
 #include "screen.h"
+#include "stats.h"
+#include "trace.h"
 #include "util.h"
 #include "xalloc.h"
 
-// evilwm only supports one display at a time; this variable is global:
+// The display currently being handled:
 struct display display = { 0 };
 
+// Everything specific to one display.  The current display's state lives in
+// the usual globals, so that nothing else needs to know about this; the rest
+// are parked here until display_switch() swaps them in.
+struct display_context {
+	struct display display;
+	struct list *clients_tab_order;
+	struct client *current;
+	unsigned numlockmask;
+	int need_client_tidy;
+};
+
+static struct display_context *contexts = NULL;
+static int ndisplays = 0;
+static int current_context = 0;
+
+// The display the main loop waits on: the first, unless its connection is
+// lost.  The others are watched with watch_fd().
+static int main_context = 0;
+
+// Where the I/O error handler escapes to when one of several displays' connection
+// is lost, and which display it was.  Xlib exits if the handler returns.
+static jmp_buf io_error_escape;
+static int io_error_armed = 0;
+static Display *io_error_dpy = NULL;
+
 // List of atom names.  Reflect any changes here in the enum in display.h.
 static const char *atom_list[] = {
 	// Standard X protocol atoms
@@ -53,6 +84,7 @@ static const char *atom_list[] = {
 	// evilwm atoms
 	"_EVILWM_UNMAXIMISED_HORZ",
 	"_EVILWM_UNMAXIMISED_VERT",
+	"_EVILWM_STATS",
 
 	// EWMH: Root Window Properties (and Related Messages)
 	"_NET_SUPPORTED",
@@ -85,6 +117,8 @@ static const char *atom_list[] = {
 	"_NET_WM_STATE_HIDDEN",
 	"_NET_WM_STATE_FULLSCREEN",
 	"_NET_WM_STATE_FOCUSED",
+	"_NET_WM_STATE_ABOVE",
+	"_NET_WM_STATE_BELOW",
 	"_NET_WM_ALLOWED_ACTIONS",
 	"_NET_WM_ACTION_MOVE",
 	"_NET_WM_ACTION_RESIZE",
@@ -97,44 +131,292 @@ static const char *atom_list[] = {
 	"_NET_FRAME_EXTENTS",
 };
 
-// Open and initialise display.  Exits the process on failure.
-void display_open(void) {
-	LOG_ENTER("display_open()");
+// Swap the globals for one display with those for another.
 
-	display.dpy = XOpenDisplay(option.display);
-	if (!display.dpy) {
-		LOG_ERROR("can't open display %s\n", option.display);
-		exit(1);
-	}
-	display.info_window = None;
+static void display_switch(int i) {
+	struct display_context *ctx;
+	if (i == current_context)
+		return;
 
-	XSetErrorHandler(handle_xerror);
+	ctx = &contexts[current_context];
+	ctx->display = display;
+	ctx->clients_tab_order = clients_tab_order;
+	ctx->current = current;
+	ctx->numlockmask = numlockmask;
+	ctx->need_client_tidy = need_client_tidy;
 
-	// While debugging, synchronous behaviour may be desirable:
-	//XSynchronize(display.dpy, True);
+	ctx = &contexts[i];
+	display = ctx->display;
+	clients_tab_order = ctx->clients_tab_order;
+	current = ctx->current;
+	numlockmask = ctx->numlockmask;
+	need_client_tidy = ctx->need_client_tidy;
 
-	// Sanity check that there's a name for each atom in the enum:
-	assert(NUM_ATOMS == (sizeof(atom_list)/sizeof(atom_list[0])));
+	current_context = i;
+}
+
+// The main loop only waits on the first display.  Others are watched like any
+// other file descriptor, and their events handled with that display current.
+
+static void handle_display_readable(int fd) {
+	int previous = current_context;
+	for (int i = 0; i < ndisplays; i++) {
+		if (i != previous && contexts[i].display.dpy
+		    && ConnectionNumber(contexts[i].display.dpy) == fd) {
+			display_switch(i);
+			event_process_pending();
+			display_switch(previous);
+			return;
+		}
+	}
+}
 
-	// Get or create all required atom IDs
-	for (int i = 0; i < NUM_ATOMS; i++) {
-		display.atom[i] = XInternAtom(display.dpy, atom_list[i], False);
+// Handle events that Xlib has already read from other displays' connections.
+// A request made with another display current (e.g., XQueryPointer() from a
+// timer via display_foreach()) reads any events that arrive ahead of its reply
+// into that display's queue, after which its connection may never become
+// readable to wake select().
+
+int display_process_queued(void) {
+	int previous = current_context;
+	int handled = 0;
+	for (int i = 0; i < ndisplays; i++) {
+		if (i != previous && contexts[i].display.dpy
+		    && XQLength(contexts[i].display.dpy) > 0) {
+			display_switch(i);
+			event_process_pending();
+			handled = 1;
+		}
 	}
+	display_switch(previous);
+	return handled;
+}
+
+// Measure a string in the font.  Returns its width, or -1 if the font
+// doesn't exist (the error this raises is ignored).  The font's ascent and
+// descent are stored through 'ascent' and 'descent'.
+
+static int query_text_width(Font font, const char *s, int len, int *ascent, int *descent) {
+	XCharStruct overall;
+	int direction;
+	unsigned long first = NextRequest(display.dpy);
+	ignore_xerrors(first, first);
+	TRACE_BEGIN(TRACE_XQUERYTEXTEXTENTS, 0);
+	Status ok = XQueryTextExtents(display.dpy, font, s, len, &direction,
+	                              ascent, descent, &overall);
+	TRACE_END(TRACE_XQUERYTEXTEXTENTS);
+	return ok ? overall.width : -1;
+}
+
+// Load a font by name, without the per-glyph metrics XLoadQueryFont() would
+// fetch: for a large Unicode font, that's megabytes never looked at.
+
+static Font load_font(const char *name) {
+	unsigned long first = NextRequest(display.dpy);
+	ignore_xerrors(first, first);
+	Font font = XLoadFont(display.dpy, name);
+	int width = query_text_width(font, " ", 1, &display.font_ascent, &display.font_descent);
+	if (width < 0)
+		return None;
+	for (int i = 0; i < 256; i++)
+		display.glyph_width[i] = -1;
+	display.glyph_width[' '] = width;
+	return font;
+}
+
+// Load the font used for window info.  A failure is reported once, after
+// which everything carries on without drawing text.
 
-	// Get the font used for window info
-	display.font = XLoadQueryFont(display.dpy, option.font);
+int display_font(void) {
+	// Nobody looks at a headless display
+	if (display.font || display.font_failed || option.headless)
+		return display.font != None;
+	display.font = load_font(option.font);
 	if (!display.font) {
 		LOG_DEBUG("failed to load specified font, trying default: %s\n", DEF_FONT);
-		display.font = XLoadQueryFont(display.dpy, DEF_FONT);
+		display.font = load_font(DEF_FONT);
 	}
 	if (!display.font) {
 		LOG_ERROR("couldn't find a font to use: try starting with -fn fontname\n");
+		display.font_failed = 1;
+		return 0;
+	}
+	for (int i = 0; i < display.nscreens; i++)
+		XSetFont(display.dpy, display.screens[i].invert_gc, display.font);
+	return 1;
+}
+
+// Sum the widths of a string's glyphs, measuring each glyph the first time it
+// is seen.  Core fonts don't kern, so this is the width of the whole string.
+// Only the glyphs actually drawn are ever measured, and each only once, so a
+// string made of glyphs seen before costs no requests.
+
+int display_text_width(const char *s, int len) {
+	int width = 0;
+	for (int i = 0; i < len; i++) {
+		unsigned char g = s[i];
+		if (display.glyph_width[g] < 0) {
+			int ascent, descent;
+			int w = query_text_width(display.font, (const char *)&g, 1, &ascent, &descent);
+			display.glyph_width[g] = (w > 0) ? w : 0;
+			STATS_GLYPH_QUERY();
+		}
+		width += display.glyph_width[g];
+	}
+	return width;
+}
+
+// Cursors used for different actions
+
+static Cursor load_cursor(Cursor *cursor, unsigned shape) {
+	if (*cursor == None && !option.headless)
+		*cursor = XCreateFontCursor(display.dpy, shape);
+	return *cursor;
+}
+
+Cursor display_move_cursor(void) {
+	return load_cursor(&display.move_curs, XC_fleur);
+}
+
+Cursor display_resize_cursor(void) {
+	return load_cursor(&display.resize_curs, XC_plus);
+}
+
+int display_current(void) {
+	return current_context;
+}
+
+void display_foreach(void (*func)(void)) {
+	int previous = current_context;
+	for (int i = 0; i < ndisplays; i++) {
+		if (i != previous && !contexts[i].display.dpy)
+			continue;
+		display_switch(i);
+		func();
+	}
+	display_switch(previous);
+}
+
+// The display connection for a context, whether or not it's current.  NULL
+// once its connection has been lost.
+
+static Display *context_dpy(int i) {
+	return (i == current_context) ? display.dpy : contexts[i].display.dpy;
+}
+
+// Called by Xlib when a display's connection fails.  If others remain, escape
+// to display_main_loop() to drop just this one.
+
+static int handle_xioerror(Display *dpy) {
+	int live = 0;
+	for (int i = 0; i < ndisplays; i++) {
+		if (context_dpy(i))
+			live++;
+	}
+	if (io_error_armed && live > 1) {
+		io_error_dpy = dpy;
+		longjmp(io_error_escape, 1);
+	}
+	LOG_ERROR("lost connection to display %s\n", DisplayString(dpy));
+	exit(1);
+}
+
+// Forget a display whose connection has been lost.  Nothing more can be sent
+// to its server, so its clients and screens are just freed.  Xlib can't free
+// the Display itself without talking to the server, so only its socket is
+// closed.
+
+static void display_lost(Display *dpy) {
+	int lost = -1;
+	for (int i = 0; i < ndisplays; i++) {
+		if (context_dpy(i) == dpy)
+			lost = i;
+	}
+	if (lost < 0)
+		return;
+	LOG_ERROR("lost connection to display %s\n", DisplayString(dpy));
+	display_switch(lost);
+	if (lost != main_context)
+		unwatch_fd(ConnectionNumber(dpy));
+	ignore_xerror = 0;
+
+	while (clients_tab_order) {
+		struct client *c = clients_tab_order->data;
+		clients_tab_order = list_delete(clients_tab_order, c);
+		client_free(c);
+	}
+	current = NULL;
+	need_client_tidy = 0;
+	for (int i = 0; i < display.nscreens; i++) {
+		struct screen *s = &display.screens[i];
+		free(s->monitors);
+		free(s->mru);
+		free(s->stack);
+		free(s->docks);
+		free(s->client_list);
+		free(s->display);
+	}
+	free(display.screens);
+	close(ConnectionNumber(dpy));
+	display.dpy = NULL;
+
+	// If it was the one the main loop waits on, another takes its place.
+	if (lost == main_context) {
+		for (int i = 0; i < ndisplays; i++) {
+			if (i != lost && contexts[i].display.dpy) {
+				main_context = i;
+				unwatch_fd(ConnectionNumber(contexts[i].display.dpy));
+				break;
+			}
+		}
+	}
+	display_switch(main_context);
+}
+
+void display_main_loop(void) {
+	if (setjmp(io_error_escape))
+		display_lost(io_error_dpy);
+	io_error_armed = 1;
+	event_main_loop();
+	io_error_armed = 0;
+}
+
+// Open and initialise one display, leaving it current.  Exits the process on
+// failure.
+
+static void display_open_one(const char *name) {
+	LOG_ENTER("display_open_one(%s)", name);
+
+	// Park the previous display.  The new context is zeroed, so this one
+	// starts from scratch.
+	contexts = xrealloc(contexts, (ndisplays + 1) * sizeof(*contexts));
+	memset(&contexts[ndisplays], 0, sizeof(*contexts));
+	display_switch(ndisplays++);
+
+	display.dpy = XOpenDisplay(name);
+	if (!display.dpy) {
+		LOG_ERROR("can't open display %s\n", name);
 		exit(1);
 	}
+	display.info_window = None;
 
-	// Cursors used for different actions
-	display.move_curs = XCreateFontCursor(display.dpy, XC_fleur);
-	display.resize_curs = XCreateFontCursor(display.dpy, XC_plus);
+	// Don't leak the X connection into spawned processes.
+	fcntl(ConnectionNumber(display.dpy), F_SETFD, FD_CLOEXEC);
+
+	XSetErrorHandler(handle_xerror);
+	XSetIOErrorHandler(handle_xioerror);
+
+	// While debugging, synchronous behaviour may be desirable:
+	//XSynchronize(display.dpy, True);
+
+	// Sanity check that there's a name for each atom in the enum:
+	assert(NUM_ATOMS == (sizeof(atom_list)/sizeof(atom_list[0])));
+
+	// Get or create all required atom IDs in one round trip
+	XInternAtoms(display.dpy, (char **)atom_list, NUM_ATOMS, False, display.atom);
+
+	// The font and cursors are left until first needed (see
+	// display_font(), etc.): plenty of sessions never use them.
 
 	// Find out which modifier is NumLock - for every grab, we need to also
 	// grab the combination where this is set.
@@ -179,23 +461,49 @@ void display_open(void) {
 		screen_init(&display.screens[i]);
 	}
 
+	if (ndisplays > 1)
+		watch_fd(ConnectionNumber(display.dpy), handle_display_readable);
+
 	LOG_LEAVE();
 }
 
+// Open and initialise each display in a whitespace-separated list.  An empty
+// list opens the default display.
+
+void display_open(const char *names) {
+	char *list = xstrdup(names ? names : "");
+	char *saveptr = NULL;
+	const char *name = strtok_r(list, " \t", &saveptr);
+	if (!name) {
+		display_open_one("");
+	}
+	while (name) {
+		display_open_one(name);
+		name = strtok_r(NULL, " \t", &saveptr);
+	}
+	free(list);
+	display_switch(main_context);
+}
+
 // Close display.  Unmanages all windows cleanly.  While managing, windows will
 // have been offset to account for borders, gravity, etc.  This will undo those
 // offsets so that repeatedly restarting window managers doesn't result in
 // moved windows.
 
-void display_close(void) {
+static void display_close_one(void) {
 
-	while (clients_stacking_order)
-		remove_client(clients_stacking_order->data);
+	// Remove from the bottom up: each window is reparented to the top of
+	// the root's stack, so this preserves the stacking order.
+	for (int i = 0; i < display.nscreens; i++) {
+		struct screen *s = &display.screens[i];
+		while (s->nstack)
+			remove_client(s->stack[0]);
+	}
 
 	XSetInputFocus(display.dpy, PointerRoot, RevertToPointerRoot, CurrentTime);
 
 	if (display.font)
-		XFreeFont(display.dpy, display.font);
+		XUnloadFont(display.dpy, display.font);
 
 	for (int i = 0; i < display.nscreens; i++) {
 		screen_deinit(&display.screens[i]);
@@ -209,3 +517,19 @@ void display_close(void) {
 	XCloseDisplay(display.dpy);
 	display.dpy = 0;
 }
+
+// Close all displays, most recently opened first.
+
+void display_close(void) {
+	for (int i = ndisplays - 1; i >= 0; i--) {
+		display_switch(i);
+		if (!display.dpy)
+			continue;
+		if (i != main_context)
+			unwatch_fd(ConnectionNumber(display.dpy));
+		display_close_one();
+	}
+	free(contexts);
+	contexts = NULL;
+	ndisplays = 0;
+}
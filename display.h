@@ -4,7 +4,8 @@
 
 // Display management.
 //
-// One evilwm process can manage one display.
+// One evilwm process can manage any number of displays.  The one currently
+// being handled is in the 'display' global; see display_open().
 
 #ifndef EVILWM_DISPLAY_H_
 #define EVILWM_DISPLAY_H_
@@ -29,6 +30,7 @@ enum {
 	// evilwm atoms
 	X_ATOM__EVILWM_UNMAXIMISED_HORZ,
 	X_ATOM__EVILWM_UNMAXIMISED_VERT,
+	X_ATOM__EVILWM_STATS,
 
 	// EWMH: Root Window Properties (and Related Messages)
 	X_ATOM__NET_SUPPORTED,
@@ -61,6 +63,8 @@ enum {
 	X_ATOM__NET_WM_STATE_HIDDEN,
 	X_ATOM__NET_WM_STATE_FULLSCREEN,
 	X_ATOM__NET_WM_STATE_FOCUSED,
+	X_ATOM__NET_WM_STATE_ABOVE,
+	X_ATOM__NET_WM_STATE_BELOW,
 	X_ATOM__NET_WM_ALLOWED_ACTIONS,
 	X_ATOM__NET_WM_ACTION_MOVE,
 	X_ATOM__NET_WM_ACTION_RESIZE,
@@ -77,6 +81,9 @@ enum {
 
 #define X_ATOM(a) display.atom[X_ATOM_ ## a]
 
+// Number of request serial ranges remembered by ignore_xerrors()
+#define MAX_IGNORED_RANGES 8
+
 struct display {
 	// The display handle
 	Display *dpy;
@@ -84,10 +91,15 @@ struct display {
 	// Atoms
 	Atom atom[NUM_ATOMS];
 
-	// Font
-	XFontStruct *font;
+	// Font, loaded on first use by display_font().  Only its ascent and
+	// descent are fetched; glyph widths are measured as strings need them
+	// (see display_text_width()), -1 until then.
+	Font font;
+	int font_ascent, font_descent;
+	int font_failed;
+	short glyph_width[256];
 
-	// Cursors
+	// Cursors, created on first use by display_move_cursor(), etc.
 	Cursor move_curs;
 	Cursor resize_curs;
 
@@ -109,15 +121,65 @@ struct display {
 #ifdef INFOBANNER
 	Window info_window;
 #endif
+
+	// Request serials are per-display, so state that refers to them is
+	// kept here.  See ignore_xerrors() and discard_enter_events().
+	struct {
+		unsigned long first, last;
+	} ignored_ranges[MAX_IGNORED_RANGES];
+	unsigned next_ignored_range;
+	unsigned long discard_enter_serial;
+	Window discard_enter_except;
+
+	// Client waiting for the pointer to settle before taking focus (see
+	// -focusdelay), and where the pointer was last seen.
+	Window focus_pending;
+	int focus_x, focus_y;
+	unsigned focus_rearms;
 };
 
-// evilwm only supports one display at a time; this variable is global:
+// The display currently being handled.  When managing more than one display,
+// this and the other per-display globals (client lists, etc.) are swapped in
+// and out by display_switch().
 extern struct display display;
 
-// Open and initialise display.  Exits the process on failure.
-void display_open(void);
+// Open and initialise each display in a whitespace-separated list.  The first
+// is left current; events for the others are handled as they arrive, except
+// during the modal loops (dragging, sweeping, holding Alt+Tab), which wait only
+// on the display being operated on: other displays' events queue until the
+// loop finishes.  Exits the process on failure.
+void display_open(const char *names);
 
-// Close display.
+// Close all displays.
 void display_close(void);
 
+// Run the main event loop until something signals to quit.  If the connection
+// to one of several displays is lost, that display is dropped and the others
+// carry on; losing the last one exits the process, as Xlib would.
+void display_main_loop(void);
+
+// Index of the current display in the list given to display_open().  Window
+// IDs are only unique within one display, so anything remembering a window
+// across events also records this.
+int display_current(void);
+
+// Handle any events already queued by Xlib for displays other than the current
+// one.  Called before waiting for input.  Returns non-zero if any were handled.
+int display_process_queued(void);
+
+// Font for window information, loaded the first time it's needed.  Returns
+// zero if there is none (e.g., when headless).
+int display_font(void);
+
+// Width of a string drawn in that font.
+int display_text_width(const char *s, int len);
+
+// Cursors for moving and resizing, created the first time they're needed.
+Cursor display_move_cursor(void);
+Cursor display_resize_cursor(void);
+
+// Call a function with each display current in turn.  Timers are shared by all
+// displays, so a timer handler with per-display work uses this.
+void display_foreach(void (*func)(void));
+
 #endif
@@ -0,0 +1,70 @@
+#!/usr/bin/env python3
+
+# Forward a local TCP port to an X server's Unix socket, delaying everything
+# sent in each direction by half the given round trip time.  Requests and
+# replies are still pipelined: only blocking round trips pay the full latency.
+#
+# Used by stats-check.sh to run evilwm as if on a distant display.  Point
+# evilwm at it with, e.g., "-display 127.0.0.1:98" for port 6098.
+
+import asyncio
+import socket
+import sys
+
+
+# Copy one direction of a connection, delivering each chunk 'delay' seconds
+# after it was read.
+
+async def forward(reader, writer, delay):
+    loop = asyncio.get_running_loop()
+    queue = asyncio.Queue()
+
+    async def deliver():
+        while True:
+            due, data = await queue.get()
+            wait = due - loop.time()
+            if wait > 0:
+                await asyncio.sleep(wait)
+            if not data:
+                break
+            writer.write(data)
+            await writer.drain()
+        writer.close()
+
+    sender = asyncio.ensure_future(deliver())
+    try:
+        while True:
+            data = await reader.read(65536)
+            queue.put_nowait((loop.time() + delay, data))
+            if not data:
+                break
+    except ConnectionError:
+        queue.put_nowait((loop.time(), b""))
+    await sender
+
+
+async def main():
+    if len(sys.argv) != 4:
+        sys.exit("usage: %s rtt-ms port socket" % sys.argv[0])
+    delay = int(sys.argv[1]) / 2000
+    port = int(sys.argv[2])
+    path = sys.argv[3]
+
+    async def connection(client_reader, client_writer):
+        client_writer.get_extra_info("socket").setsockopt(
+            socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        try:
+            server_reader, server_writer = await asyncio.open_unix_connection(path)
+        except OSError:
+            client_writer.close()
+            return
+        await asyncio.gather(forward(client_reader, server_writer, delay),
+                             forward(server_reader, client_writer, delay),
+                             return_exceptions=True)
+
+    server = await asyncio.start_server(connection, "127.0.0.1", port)
+    async with server:
+        await server.serve_forever()
+
+
+asyncio.run(main())
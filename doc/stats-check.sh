@@ -0,0 +1,355 @@
+#!/bin/sh
+
+# Count the X requests made by common window manager operations.
+#
+# Runs evilwm headless on a private Xvfb, drives it through its control socket
+# and reads the -stats record after each step.  Prints one line per step:
+#
+#     step requests roundtrips allocations
+#
+# The focus, raise, vdesk and dock steps are then repeated, and fail if they
+# make any heap allocations: in steady state, they shouldn't.  Only evilwm's own
+# allocations are counted (see stats.h).
+#
+# Unless -k is given, evilwm is then restarted without -headless and driven
+# with xdotool, to show the window information banner, drag a window and sweep
+# (resize) it.  Each is done twice, and the second time must not allocate or
+# measure any glyphs again.
+#
+# With -k, evilwm runs in kiosk mode with the client's windows matched by -app,
+# so that the map steps show the cost of setting up a kiosk window; compare
+# with a run without -k.  Each client window must then fill the screen.
+#
+# Unless -k is given or the latency is 0, evilwm is restarted once more with
+# -remote, this time connected through latency-proxy.py, which delays all
+# traffic by a round trip time set with -l (default 40ms).  Pointer focus,
+# raise, switching vdesk and back, Alt+Tab and unmanaging a window (killing its
+# client) must each make no more blocking round trips than their budget in
+# 'roundtrip_budgets' below.
+#
+# The most blocking round trips evilwm made managing any one window must be
+# within a budget, set with -r.  The default allows for the twelve a new window
+# needs (the reads of its geometry, attributes, class, hints, transient-for,
+# window type, state and four other properties, and the pointer position to
+# place it); a kiosk window isn't placed, so needs one fewer.
+#
+# The requests and round trips of the headless focus, raise, vdesk and dock
+# steps must match those in 'expected' below, which were worked out from the
+# code.  Other steps depend on the client, and aren't checked.  Nor is
+# anything if -k or EVILWM_ARGS is given, as both change the counts.
+#
+# With -b, the counts must also match those in a baseline file exactly (save
+# the output of a previous run to make one).  The exit status is non-zero if
+# any check fails.  evilwm must be built with -DSTATS.  Needs Xvfb, socat and an X
+# client to map (xmessage by default, or set CLIENT and CLIENT_CLASS), and
+# xwininfo for -k, or xdotool and python3 otherwise.  Any further evilwm options, e.g.
+# -remote, can be given in EVILWM_ARGS.
+
+usage() {
+	echo "usage: $0 [-k] [-b baseline] [-d display] [-l ms] [-r roundtrips] [evilwm]" >&2
+	exit 1
+}
+
+baseline=
+dpy=:97
+kiosk=
+budget=
+latency=40
+while getopts "b:d:kl:r:" opt; do
+	case "$opt" in
+	b) baseline="$OPTARG" ;;
+	d) dpy="$OPTARG" ;;
+	k) kiosk=1 ;;
+	l) latency="$OPTARG" ;;
+	r) budget="$OPTARG" ;;
+	*) usage ;;
+	esac
+done
+shift $((OPTIND - 1))
+evilwm="${1:-./evilwm}"
+client="${CLIENT:-xmessage}"
+client_class="${CLIENT_CLASS:-Xmessage}"
+if test -z "$budget"; then
+	budget=12
+	test -n "$kiosk" && budget=11
+fi
+
+# Requests and round trips expected of headless steps.  With three clients
+# mapped, each focus change shows and raises the new window, publishes the
+# stacking order, sets focus, updates _NET_WM_STATE and _NET_ACTIVE_WINDOW for
+# both windows, and syncs to discard enter events.  Leaving a vdesk deselects
+# the current window and hides all three; returning shows them.  With no docks,
+# toggling docks costs nothing.  The vdesk steps leave nothing focused, so the
+# steady focus change has no old window to update, and nothing to raise.
+expected="
+focus-next 10 1
+focus-next-again 10 1
+raise-top 0 0
+vdesk-away 9 0
+vdesk-back 7 0
+docks-hide 0 0
+docks-show 0 0
+steady-focus-next 6 1
+steady-raise-top 0 0
+steady-vdesk-away 9 0
+steady-vdesk-back 7 0
+steady-docks-hide 0 0
+steady-docks-show 0 0
+"
+check_expected=1
+test -n "$kiosk" && check_expected=
+test -n "$EVILWM_ARGS" && check_expected=
+
+# Most blocking round trips each operation may make on a distant display.  In
+# -remote mode, only Alt+Tab's keyboard grab need wait for the server.
+roundtrip_budgets="
+remote-focus 0
+remote-raise 0
+remote-vdesk-away 0
+remote-vdesk-back 0
+remote-alt-tab 1
+remote-unmanage 0
+"
+
+tmp=$(mktemp -d) || exit 1
+sock="$tmp/control"
+out="$tmp/out"
+pids=
+steady=
+failed=
+
+cleanup() {
+	for pid in $pids; do
+		kill "$pid" 2>/dev/null
+	done
+	rm -rf "$tmp"
+}
+trap cleanup EXIT
+trap 'exit 1' INT TERM
+
+die() {
+	echo "$0: $*" >&2
+	exit 1
+}
+
+# The value of one line of the current stats record
+stat() {
+	sed -n "s/^$1 //p" "$stats" 2>/dev/null
+}
+
+# Wait for the stats record to settle: the request count unchanged across a
+# publishing interval, so nothing is still in progress.
+settle() {
+	prev=$(stat requests)
+	tries=0
+	while :; do
+		sleep 1.2
+		now=$(stat requests)
+		test -n "$now" && test "$now" = "$prev" && return
+		prev="$now"
+		tries=$((tries + 1))
+		test "$tries" -lt 20 || die "stats never settled"
+	done
+}
+
+# Wait until evilwm manages n clients
+wait_clients() {
+	tries=0
+	until test "$(stat clients)" = "$1"; do
+		sleep 0.2
+		tries=$((tries + 1))
+		test "$tries" -lt 100 || die "expected $1 clients"
+	done
+}
+
+# Run a step and report the requests, round trips and allocations it took.  The
+# step is a control command, "map NAME" to map a new client window, "unmanage"
+# to kill the current client and wait for it to go, "key KEYS" to press and
+# release keys, "point NAME" to move the pointer into a window, or "drag NAME"
+# or "sweep NAME" to move or resize a window with Alt and the mouse.  If steady
+# is set, the step must not allocate or measure any glyphs.  Any expected
+# requests and round trips must match, and round trips must be within budget.
+step() {
+	name="$1"
+	shift
+	settle
+	r0=$(stat requests)
+	t0=$(stat roundtrips)
+	a0=$(stat allocations)
+	g0=$(stat glyph_queries)
+	case "$1" in
+	map)
+		n=$(stat clients)
+		DISPLAY="$dpy" "$client" -name "$2" "$2" &
+		pids="$pids $!"
+		wait_clients $((n + 1))
+		;;
+	unmanage)
+		n=$(stat clients)
+		echo kill | socat - "UNIX-CONNECT:$sock" || die "control socket"
+		wait_clients $((n - 1))
+		;;
+	key)
+		DISPLAY="$dpy" xdotool keydown "$2" sleep 0.5 keyup "$2"
+		;;
+	point)
+		DISPLAY="$dpy" xdotool search --name "$2" mousemove --window %1 20 20
+		;;
+	drag|sweep)
+		button=1
+		test "$1" = sweep && button=3
+		DISPLAY="$dpy" xdotool search --name "$2" mousemove --window %1 20 20 \
+			keydown alt mousedown "$button" sleep 0.2 \
+			mousemove_relative 40 30 sleep 0.2 mousemove_relative 40 30 \
+			sleep 0.2 mouseup "$button" keyup alt
+		;;
+	*)
+		echo "$*" | socat - "UNIX-CONNECT:$sock" || die "control socket"
+		;;
+	esac
+	settle
+	allocs=$(($(stat allocations) - a0))
+	counts="$(($(stat requests) - r0)) $(($(stat roundtrips) - t0))"
+	echo "$name $counts $allocs" | tee -a "$out"
+	want=$(echo "$expected" | sed -n "s/^$name //p")
+	if test -n "$check_expected" && test -n "$want" && test "$counts" != "$want"; then
+		echo "$0: $name made $counts requests and round trips, expected $want" >&2
+		failed=1
+	fi
+	roundtrips=${counts#* }
+	max=$(echo "$roundtrip_budgets" | sed -n "s/^$name //p")
+	if test -n "$max" && test "$roundtrips" -gt "$max"; then
+		echo "$0: $name made $roundtrips round trips, budget $max" >&2
+		failed=1
+	fi
+	if test -n "$steady" && test "$allocs" -ne 0; then
+		echo "$0: $name allocated in steady state" >&2
+		failed=1
+	fi
+	if test -n "$steady" && test "$(stat glyph_queries)" -ne "$g0"; then
+		echo "$0: $name measured glyphs already seen" >&2
+		failed=1
+	fi
+}
+
+# Check that a kiosk client window, not just its frame, fills the screen
+check_kiosk() {
+	geom=$(DISPLAY="$dpy" xwininfo -name "$1" | sed -n 's/^ *Width: /w=/p;s/^ *Height: /h=/p' | tr '\n' ' ')
+	if test "$geom" != "w=$screen_w h=$screen_h "; then
+		echo "$0: kiosk window $1 is $geom, not ${screen_w}x$screen_h" >&2
+		failed=1
+	fi
+}
+
+screen_w=1024
+screen_h=768
+Xvfb "$dpy" -nolisten tcp -screen 0 ${screen_w}x${screen_h}x24 >/dev/null 2>&1 &
+pids="$pids $!"
+sleep 1
+
+# Start evilwm with the given options, and wait for its stats and control
+# socket to appear.  It connects to evilwm_dpy, which is the Xvfb display
+# unless going through the latency proxy.
+evilwm_dpy="$dpy"
+start_evilwm() {
+	rm -f "$sock"
+	"$evilwm" -display "$evilwm_dpy" -stats 1 -control "$sock" "$@" $EVILWM_ARGS &
+	evilwm_pid=$!
+	pids="$evilwm_pid $pids"
+	stats="${XDG_RUNTIME_DIR:-/tmp}/evilwm-stats.$evilwm_pid"
+	tries=0
+	until test -S "$sock" && test -f "$stats"; do
+		sleep 0.2
+		tries=$((tries + 1))
+		test "$tries" -lt 50 || die "evilwm didn't start"
+	done
+}
+
+if test -n "$kiosk"; then
+	start_evilwm -headless -kiosk -app "/$client_class"
+else
+	start_evilwm -headless
+fi
+
+step map-first map one
+step map-second map two
+step map-third map three
+if test -n "$kiosk"; then
+	for w in one two three; do
+		check_kiosk "$w"
+	done
+fi
+# Focus transitions: each Alt+Tab moves focus to another window and raises it
+step focus-next next
+step focus-next-again next
+# Re-raising the window already on top should cost nothing
+step raise-top raise
+step vdesk-away vdesk 1
+step vdesk-back vdesk 0
+step docks-hide docks
+step docks-show docks
+
+# Everything has been done once, so any buffers have grown to size
+steady=1
+step steady-focus-next next
+step steady-raise-top raise
+step steady-vdesk-away vdesk 1
+step steady-vdesk-back vdesk 0
+step steady-docks-hide docks
+step steady-docks-show docks
+
+manage=$(stat manage_roundtrips_max)
+if test "$manage" -gt "$budget"; then
+	echo "$0: managing a window took $manage round trips, budget $budget" >&2
+	failed=1
+fi
+
+# Operations that need the keyboard or pointer: restart evilwm with input
+# handled, and drive it with xdotool.  The windows are managed again.
+if test -z "$kiosk"; then
+	echo quit | socat - "UNIX-CONNECT:$sock"
+	wait "$evilwm_pid"
+	start_evilwm
+	wait_clients 3
+	steady=
+	step pointer-focus next
+	# The window information banner measures its text.  Showing it again
+	# for the same window must not measure anything again.
+	step info key ctrl+alt+i
+	step drag drag one
+	step sweep sweep one
+	steady=1
+	step steady-info key ctrl+alt+i
+	step steady-drag drag one
+	step steady-sweep sweep one
+fi
+
+# Operations on a distant display.  The proxy listens on the TCP port of the
+# next display number, and forwards to Xvfb's socket.  Clients and xdotool
+# still talk to Xvfb directly.
+if test -z "$kiosk" && test "$latency" -gt 0; then
+	n=${dpy#:}
+	n=${n%%.*}
+	python3 "$(dirname "$0")/latency-proxy.py" "$latency" $((6000 + n + 1)) "/tmp/.X11-unix/X$n" &
+	pids="$pids $!"
+	sleep 1
+	echo quit | socat - "UNIX-CONNECT:$sock"
+	wait "$evilwm_pid"
+	evilwm_dpy="127.0.0.1:$((n + 1))"
+	start_evilwm -remote
+	wait_clients 3
+	step remote-focus point one
+	step remote-raise raise
+	step remote-vdesk-away vdesk 1
+	step remote-vdesk-back vdesk 0
+	step remote-alt-tab key alt+Tab
+	step remote-unmanage unmanage
+fi
+
+if test -n "$baseline"; then
+	if ! diff -u "$baseline" "$out" >&2; then
+		echo "$0: request counts differ from $baseline" >&2
+		failed=1
+	fi
+fi
+test -z "$failed"
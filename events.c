@@ -35,8 +35,19 @@
 #include "list.h"
 #include "log.h"
 #include "screen.h"
+#include "stack.h"
+#include "stats.h"
+#include "termpool.h"
+#include "trace.h"
 #include "util.h"
 
+// Pointer speed, in pixels per millisecond, above which a delayed focus change
+// waits again (see -focusdelay), and how many times it will do so.
+#define FOCUS_SETTLE_SPEED 1
+#define FOCUS_MAX_REARMS 4
+
+static void handle_focus_timer(void);
+
 // Event loop will run until this flag is set
 int wm_exit;
 
@@ -44,6 +55,31 @@ int wm_exit;
 // Set by unhandled X errors and unmap requests.
 int need_client_tidy = 0;
 
+// Core X event names, for traces and statistics.
+const char *const event_names[LASTEvent] = {
+	[KeyPress] = "KeyPress", [KeyRelease] = "KeyRelease",
+	[ButtonPress] = "ButtonPress", [ButtonRelease] = "ButtonRelease",
+	[MotionNotify] = "MotionNotify", [EnterNotify] = "EnterNotify",
+	[LeaveNotify] = "LeaveNotify", [FocusIn] = "FocusIn",
+	[FocusOut] = "FocusOut", [KeymapNotify] = "KeymapNotify",
+	[Expose] = "Expose", [GraphicsExpose] = "GraphicsExpose",
+	[NoExpose] = "NoExpose", [VisibilityNotify] = "VisibilityNotify",
+	[CreateNotify] = "CreateNotify", [DestroyNotify] = "DestroyNotify",
+	[UnmapNotify] = "UnmapNotify", [MapNotify] = "MapNotify",
+	[MapRequest] = "MapRequest", [ReparentNotify] = "ReparentNotify",
+	[ConfigureNotify] = "ConfigureNotify",
+	[ConfigureRequest] = "ConfigureRequest",
+	[GravityNotify] = "GravityNotify", [ResizeRequest] = "ResizeRequest",
+	[CirculateNotify] = "CirculateNotify",
+	[CirculateRequest] = "CirculateRequest",
+	[PropertyNotify] = "PropertyNotify",
+	[SelectionClear] = "SelectionClear",
+	[SelectionRequest] = "SelectionRequest",
+	[SelectionNotify] = "SelectionNotify",
+	[ColormapNotify] = "ColormapNotify", [ClientMessage] = "ClientMessage",
+	[MappingNotify] = "MappingNotify", [GenericEvent] = "GenericEvent",
+};
+
 // Process keyboard events.
 
 static void handle_key_event(XKeyEvent *e) {
@@ -52,20 +88,48 @@ static void handle_key_event(XKeyEvent *e) {
 
 	switch (key) {
 		case KEY_NEW:
+#ifdef TERMPOOL
+			if (termpool_take(current_screen))
+				break;
+#endif
 			spawn((const char *const *)option.term);
 			break;
 		case KEY_NEXT:
-			client_select_next();
-			if (XGrabKeyboard(display.dpy, e->root, False, GrabModeAsync, GrabModeAsync, CurrentTime) == GrabSuccess) {
-				XEvent ev;
-				do {
-					XMaskEvent(display.dpy, KeyPressMask|KeyReleaseMask, &ev);
-					if (ev.type == KeyPress && XkbKeycodeToKeysym(display.dpy, ev.xkey.keycode, 0, 0) == KEY_NEXT)
-						client_select_next();
-				} while (ev.type == KeyPress || XkbKeycodeToKeysym(display.dpy, ev.xkey.keycode, 0, 0) == KEY_NEXT);
-				XUngrabKeyboard(display.dpy, CurrentTime);
+			// Holding Shift (altmask) cycles in reverse.  While the
+			// keys are held, candidates are only previewed by
+			// border colour: the one chosen is raised and focused
+			// on release.
+			{
+				struct client *preview = client_find_next(NULL, e->state & altmask);
+				if (!preview)
+					break;
+				TRACE_BEGIN(TRACE_XGRABKEYBOARD, 0);
+				int grab = XGrabKeyboard(display.dpy, e->root, False, GrabModeAsync, GrabModeAsync, CurrentTime);
+				TRACE_END(TRACE_XGRABKEYBOARD);
+				if (grab == GrabSuccess) {
+					XEvent ev;
+					if (current)
+						client_highlight(current, 0);
+					client_highlight(preview, 1);
+					do {
+						XMaskEvent(display.dpy, KeyPressMask|KeyReleaseMask, &ev);
+						if (ev.type == KeyPress && XkbKeycodeToKeysym(display.dpy, ev.xkey.keycode, 0, 0) == KEY_NEXT) {
+							struct client *next = client_find_next(preview, ev.xkey.state & altmask);
+							if (next) {
+								client_highlight(preview, 0);
+								client_highlight(next, 1);
+								preview = next;
+							}
+						}
+					} while (ev.type == KeyPress || XkbKeycodeToKeysym(display.dpy, ev.xkey.keycode, 0, 0) == KEY_NEXT);
+					XUngrabKeyboard(display.dpy, CurrentTime);
+				}
+				if (preview != current)
+					client_activate(preview);
+				else
+					client_update_border(preview);
+				client_mru_touch(preview);
 			}
-			clients_tab_order = list_to_head(clients_tab_order, current);
 			break;
 		case KEY_DOCK_TOGGLE:
 			set_docks_visible(current_screen, !current_screen->docks_visible);
@@ -96,14 +160,20 @@ static void handle_key_event(XKeyEvent *e) {
 	struct client *c = current;
 	if (c == NULL) return;
 
+	// Kiosk windows can't be moved, resized or maximised from the keyboard
+	// either.
+	if (c->is_kiosk && key != KEY_KILL && key != KEY_LOWER && key != KEY_ALTLOWER
+	    && key != KEY_INFO && key != KEY_FIX)
+		return;
+
 	struct monitor *monitor = client_monitor(c, NULL);
-	int width_inc = (c->width_inc > 1) ? c->width_inc : 16;
-	int height_inc = (c->height_inc > 1) ? c->height_inc : 16;
+	int width_inc = (c->meta->width_inc > 1) ? c->meta->width_inc : 16;
+	int height_inc = (c->meta->height_inc > 1) ? c->meta->height_inc : 16;
 
 	switch (key) {
 		case KEY_LEFT:
 			if (e->state & altmask) {
-				if ((c->width - width_inc) >= c->min_width)
+				if ((c->width - width_inc) >= c->meta->min_width)
 					c->width -= width_inc;
 			} else {
 				c->x -= 16;
@@ -111,7 +181,7 @@ static void handle_key_event(XKeyEvent *e) {
 			goto move_client;
 		case KEY_DOWN:
 			if (e->state & altmask) {
-				if (!c->max_height || (c->height + height_inc) <= c->max_height)
+				if (!c->meta->max_height || (c->height + height_inc) <= c->meta->max_height)
 					c->height += height_inc;
 			} else {
 				c->y += 16;
@@ -119,7 +189,7 @@ static void handle_key_event(XKeyEvent *e) {
 			goto move_client;
 		case KEY_UP:
 			if (e->state & altmask) {
-				if ((c->height - height_inc) >= c->min_height)
+				if ((c->height - height_inc) >= c->meta->min_height)
 					c->height -= height_inc;
 			} else {
 				c->y -= 16;
@@ -127,7 +197,7 @@ static void handle_key_event(XKeyEvent *e) {
 			goto move_client;
 		case KEY_RIGHT:
 			if (e->state & altmask) {
-				if (!c->max_width || (c->width + width_inc) <= c->max_width)
+				if (!c->meta->max_width || (c->width + width_inc) <= c->meta->max_width)
 					c->width += width_inc;
 			} else {
 				c->x += 16;
@@ -181,9 +251,9 @@ static void handle_key_event(XKeyEvent *e) {
 	return;
 
 move_client:
-	if (abs(c->x) == c->border && c->oldw != 0)
+	if (abs(c->x) == c->border && c->meta->oldw != 0)
 		c->x = 0;
-	if (abs(c->y) == c->border && c->oldh != 0)
+	if (abs(c->y) == c->border && c->meta->oldh != 0)
 		c->y = 0;
 	client_moveresizeraise(c);
 #ifdef WARP_POINTER
@@ -221,8 +291,8 @@ static void do_window_changes(int value_mask, XWindowChanges *wc, struct client
 		int gravity) {
 	LOG_XENTER("do_window_changes(window=%lx), was: %dx%d+%d+%d", (unsigned long)c->window, c->width, c->height, c->x, c->y);
 	if (gravity == 0)
-		gravity = c->win_gravity_hint;
-	c->win_gravity = gravity;
+		gravity = c->meta->win_gravity_hint;
+	c->meta->win_gravity = gravity;
 	if (value_mask & CWX) {
 		c->x = wc->x;
 		LOG_XDEBUG("CWX      x=%d\n", wc->x);
@@ -239,20 +309,20 @@ static void do_window_changes(int value_mask, XWindowChanges *wc, struct client
 		if (value_mask & CWWidth) {
 			LOG_XDEBUG("CWWidth  width=%d\n", wc->width);
 			int neww = wc->width;
-			if (neww < c->min_width)
-				neww = c->min_width;
-			if (c->max_width && neww > c->max_width)
-				neww = c->max_width;
+			if (neww < c->meta->min_width)
+				neww = c->meta->min_width;
+			if (c->meta->max_width && neww > c->meta->max_width)
+				neww = c->meta->max_width;
 			dw = neww - c->width;
 			c->width = neww;
 		}
 		if (value_mask & CWHeight) {
 			LOG_XDEBUG("CWHeight height=%d\n", wc->height);
 			int newh = wc->height;
-			if (newh < c->min_height)
-				newh = c->min_height;
-			if (c->max_height && newh > c->max_height)
-				newh = c->max_height;
+			if (newh < c->meta->min_height)
+				newh = c->meta->min_height;
+			if (c->meta->max_height && newh > c->meta->max_height)
+				newh = c->meta->max_height;
 			dh = newh - c->height;
 			c->height = newh;
 		}
@@ -321,13 +391,24 @@ static void handle_configure_request(XConfigureRequestEvent *e) {
 	wc.stack_mode = e->detail;
 
 	if (c) {
-		if (e->value_mask & CWStackMode && e->value_mask & CWSibling) {
+		unsigned long value_mask = e->value_mask;
+		if ((value_mask & CWStackMode) && (e->detail == Above || e->detail == Below)) {
+			// Raise or lower within the client's layer, skipping
+			// the request if nothing would change.
+			struct client *sibling = NULL;
+			if (value_mask & CWSibling)
+				sibling = find_client(e->above);
+			if (stack_restack(c, sibling, e->detail == Above))
+				ewmh_set_net_client_list_stacking(c->screen);
+			value_mask &= ~(CWStackMode|CWSibling);
+		} else if (value_mask & CWStackMode && value_mask & CWSibling) {
 			struct client *sibling = find_client(e->above);
 			if (sibling) {
 				wc.sibling = sibling->parent;
 			}
 		}
-		do_window_changes(e->value_mask, &wc, c, 0);
+		if (value_mask)
+			do_window_changes(value_mask, &wc, c, 0);
 		if (c == current) {
 			discard_enter_events(c);
 		}
@@ -348,9 +429,15 @@ static void handle_map_request(XMapRequestEvent *e) {
 		client_show(c);
 		client_raise(c);
 	} else {
-		XWindowAttributes attr;
-		XGetWindowAttributes(display.dpy, e->window, &attr);
-		client_manage_new(e->window, find_screen(attr.root));
+#ifdef TERMPOOL
+		if (termpool_claim(e->window, e->parent)) {
+			LOG_LEAVE();
+			return;
+		}
+#endif
+		// We only see map requests through substructure redirection on
+		// the root windows, so the parent is the root.
+		client_manage_new(e->window, find_screen(e->parent));
 	}
 	LOG_LEAVE();
 }
@@ -378,8 +465,12 @@ static void handle_colormap_change(XColormapEvent *e) {
 	struct client *c = find_client(e->window);
 
 	if (c && e->new) {
-		c->cmap = e->colormap;
-		XInstallColormap(display.dpy, c->cmap);
+		c->meta->cmap = e->colormap;
+		client_install_colormap(c);
+	} else if (c && e->state == ColormapUninstalled
+	           && e->colormap == c->screen->installed_cmap) {
+		// Someone else changed the installed colourmaps
+		c->screen->installed_cmap = None;
 	}
 }
 
@@ -391,8 +482,12 @@ static void handle_property_change(XPropertyEvent *e) {
 		if (e->atom == XA_WM_NORMAL_HINTS) {
 			get_wm_normal_hints(c);
 			LOG_DEBUG("geometry=%dx%d+%d+%d\n", c->width, c->height, c->x, c->y);
+		} else if (e->atom == XA_WM_TRANSIENT_FOR) {
+			get_transient_for(c);
 		} else if (e->atom == X_ATOM(_NET_WM_WINDOW_TYPE)) {
 			get_window_type(c);
+			if (stack_relayer(c))
+				ewmh_set_net_client_list_stacking(c->screen);
 			if (!c->is_dock && (is_fixed(c) || (c->vdesk == c->screen->vdesk))) {
 				client_show(c);
 			}
@@ -401,14 +496,79 @@ static void handle_property_change(XPropertyEvent *e) {
 	}
 }
 
+// Complete a focus change delayed by -focusdelay, if the pointer has settled
+// in the window.  If it's still moving faster than FOCUS_SETTLE_SPEED, wait
+// again, but only up to FOCUS_MAX_REARMS times.  In remote mode, the pointer
+// isn't queried, and focus simply changes after the delay.
+
+static void focus_pending_check(void) {
+	struct client *c;
+	int x, y;
+	if (!display.focus_pending)
+		return;
+	if (!(c = find_client(display.focus_pending))) {
+		display.focus_pending = None;
+		return;
+	}
+	if (!option.remote && get_pointer_root_xy(c->screen->root, &x, &y)) {
+		// Left the window without entering another client
+		if (x < c->x - c->border || x >= c->x + c->width + c->border
+		    || y < c->y - c->border || y >= c->y + c->height + c->border) {
+			display.focus_pending = None;
+			return;
+		}
+		if (display.focus_rearms < FOCUS_MAX_REARMS
+		    && abs(x - display.focus_x) + abs(y - display.focus_y) > option.focusdelay * FOCUS_SETTLE_SPEED) {
+			display.focus_x = x;
+			display.focus_y = y;
+			display.focus_rearms++;
+			set_timer(option.focusdelay, handle_focus_timer);
+			return;
+		}
+	}
+	select_client(c);
+	client_mru_touch(c);
+}
+
+static void handle_focus_timer(void) {
+	display_foreach(focus_pending_check);
+}
+
 static void handle_enter_event(XCrossingEvent *e) {
 	struct client *c;
 
+	// Enter events caused by our own rearranging (see
+	// discard_enter_events()).
+	if ((long)(e->serial - display.discard_enter_serial) < 0 && e->window != display.discard_enter_except)
+		return;
+
 	if ((c = find_client(e->window))) {
 		if (!is_fixed(c) && c->vdesk != c->screen->vdesk)
 			return;
+		// Nothing underneath a focused fullscreen client takes focus
+		// from it.
+		if (current && current->is_fullscreen && c != current
+		    && c->screen == current->screen
+		    && e->x_root >= current->x && e->x_root < current->x + current->width
+		    && e->y_root >= current->y && e->y_root < current->y + current->height)
+			return;
+		if (option.focusdelay > 0) {
+			// Wait for the pointer to settle.  Each crossing
+			// restarts the wait, so sweeping across windows
+			// focuses none of them.
+			if (c == current) {
+				display.focus_pending = None;
+				return;
+			}
+			display.focus_pending = c->window;
+			display.focus_x = e->x_root;
+			display.focus_y = e->y_root;
+			display.focus_rearms = 0;
+			set_timer(option.focusdelay, handle_focus_timer);
+			return;
+		}
 		select_client(c);
-		clients_tab_order = list_to_head(clients_tab_order, c);
+		client_mru_touch(c);
 	}
 }
 
@@ -522,12 +682,9 @@ static void handle_client_message(XClientMessageEvent *e) {
 
 	if (e->message_type == X_ATOM(_NET_RESTACK_WINDOW)) {
 		// Only do this if it came from direct user action
-		if (e->data.l[0] == 2) {
-			XWindowChanges wc;
-
-			wc.sibling = e->data.l[1];
-			wc.stack_mode = e->data.l[2];
-			do_window_changes(CWSibling | CWStackMode, &wc, c, c->win_gravity);
+		if (e->data.l[0] == 2 && (e->data.l[2] == Above || e->data.l[2] == Below)) {
+			if (stack_restack(c, find_client(e->data.l[1]), e->data.l[2] == Above))
+				ewmh_set_net_client_list_stacking(c->screen);
 		}
 		LOG_LEAVE();
 		return;
@@ -543,7 +700,7 @@ static void handle_client_message(XClientMessageEvent *e) {
 	}
 
 	if (e->message_type == X_ATOM(_NET_WM_STATE)) {
-		int i, maximise_hv = 0;
+		int i, maximise_hv = 0, fullscreen = 0, above = 0, below = 0;
 		// Message can contain up to two state changes:
 		for (i = 1; i <= 2; i++) {
 			if ((Atom)e->data.l[i] == X_ATOM(_NET_WM_STATE_MAXIMIZED_VERT)) {
@@ -551,12 +708,25 @@ static void handle_client_message(XClientMessageEvent *e) {
 			} else if ((Atom)e->data.l[i] == X_ATOM(_NET_WM_STATE_MAXIMIZED_HORZ)) {
 				maximise_hv |= MAXIMISE_HORZ;
 			} else if ((Atom)e->data.l[i] == X_ATOM(_NET_WM_STATE_FULLSCREEN)) {
-				maximise_hv |= MAXIMISE_VERT|MAXIMISE_HORZ;
+				fullscreen = 1;
+			} else if ((Atom)e->data.l[i] == X_ATOM(_NET_WM_STATE_ABOVE)) {
+				above = 1;
+			} else if ((Atom)e->data.l[i] == X_ATOM(_NET_WM_STATE_BELOW)) {
+				below = 1;
 			}
 		}
 		if (maximise_hv) {
 			client_maximise(c, e->data.l[0], maximise_hv);
 		}
+		if (fullscreen) {
+			client_fullscreen(c, e->data.l[0]);
+		}
+		if (above) {
+			client_set_layer(c, e->data.l[0], 0);
+		}
+		if (below) {
+			client_set_layer(c, e->data.l[0], 1);
+		}
 		LOG_LEAVE();
 		return;
 	}
@@ -567,79 +737,116 @@ static void handle_client_message(XClientMessageEvent *e) {
 // Run the main event loop.  This will run until something tells us to quit
 // (generally, a signal).
 
-void event_main_loop(void) {
-	// XEvent is a big union of all the core event types, but we also need
-	// to handle events about extensions, so make a union of the union...
-	union {
-		XEvent xevent;
+// XEvent is a big union of all the core event types, but we also need to
+// handle events about extensions, so make a union of the union...
+
+union event {
+	XEvent xevent;
 #ifdef SHAPE
-		XShapeEvent xshape;
+	XShapeEvent xshape;
 #endif
 #ifdef RANDR
-		XRRScreenChangeNotifyEvent xrandr;
+	XRRScreenChangeNotifyEvent xrandr;
 #endif
-	} ev;
-
-	// Main event loop
-	while (!wm_exit) {
-		if (interruptibleXNextEvent(&ev.xevent)) {
-			switch (ev.xevent.type) {
-			case KeyPress:
-				handle_key_event(&ev.xevent.xkey);
-				break;
-			case ButtonPress:
-				handle_button_event(&ev.xevent.xbutton);
-				break;
-			case ConfigureRequest:
-				handle_configure_request(&ev.xevent.xconfigurerequest);
-				break;
-			case MapRequest:
-				handle_map_request(&ev.xevent.xmaprequest);
-				break;
-			case ColormapNotify:
-				handle_colormap_change(&ev.xevent.xcolormap);
-				break;
-			case EnterNotify:
-				handle_enter_event(&ev.xevent.xcrossing);
-				break;
-			case PropertyNotify:
-				handle_property_change(&ev.xevent.xproperty);
-				break;
-			case UnmapNotify:
-				handle_unmap_event(&ev.xevent.xunmap);
-				break;
-			case MappingNotify:
-				handle_mappingnotify_event(&ev.xevent.xmapping);
-				break;
-			case ClientMessage:
-				handle_client_message(&ev.xevent.xclient);
-				break;
-			default:
+};
+
+// Handle one event.
+
+static void event_dispatch(union event *ev) {
+	TRACE_XEVENT(&ev->xevent);
+	TRACE_BEGIN(TRACE_EVENT, ev->xevent.type);
+	STATS_EVENT(ev->xevent.type);
+	STATS_INPUT_BEGIN(&ev->xevent);
+	switch (ev->xevent.type) {
+	case KeyPress:
+		handle_key_event(&ev->xevent.xkey);
+		break;
+	case ButtonPress:
+		handle_button_event(&ev->xevent.xbutton);
+		break;
+	case ConfigureRequest:
+		handle_configure_request(&ev->xevent.xconfigurerequest);
+		break;
+	case MapRequest:
+		handle_map_request(&ev->xevent.xmaprequest);
+		break;
+	case ColormapNotify:
+		handle_colormap_change(&ev->xevent.xcolormap);
+		break;
+	case EnterNotify:
+		handle_enter_event(&ev->xevent.xcrossing);
+		break;
+	case PropertyNotify:
+		handle_property_change(&ev->xevent.xproperty);
+		break;
+	case UnmapNotify:
+		handle_unmap_event(&ev->xevent.xunmap);
+		break;
+#ifdef TERMPOOL
+	case DestroyNotify:
+		termpool_forget(ev->xevent.xdestroywindow.window);
+		break;
+#endif
+	case MappingNotify:
+		handle_mappingnotify_event(&ev->xevent.xmapping);
+		break;
+	case ClientMessage:
+		handle_client_message(&ev->xevent.xclient);
+		break;
+	default:
 #ifdef SHAPE
-				if (display.have_shape
-				    && ev.xevent.type == display.shape_event) {
-					handle_shape_event(&ev.xshape);
-				}
+		if (display.have_shape
+		    && ev->xevent.type == display.shape_event) {
+			handle_shape_event(&ev->xshape);
+		}
 #endif
 #ifdef RANDR
-				if (display.have_randr && ev.xevent.type == display.randr_event_base + RRScreenChangeNotify) {
-					handle_randr_event(&ev.xrandr);
-				}
-#endif
-				break;
-			}
+		if (display.have_randr && ev->xevent.type == display.randr_event_base + RRScreenChangeNotify) {
+			handle_randr_event(&ev->xrandr);
 		}
+#endif
+		break;
+	}
+	TRACE_END(TRACE_EVENT);
+	TRACE_COUNTERS();
+	STATS_INPUT_END();
+	STATS_QUEUE(XQLength(display.dpy));
+}
 
-		// Scan list for clients flagged to be removed
-		if (need_client_tidy) {
-			struct list *iter, *niter;
-			need_client_tidy = 0;
-			for (iter = clients_tab_order; iter; iter = niter) {
-				struct client *c = iter->data;
-				niter = iter->next;
-				if (c->remove)
-					remove_client(c);
-			}
+// Scan list for clients flagged to be removed.
+
+static void tidy_clients(void) {
+	if (need_client_tidy) {
+		struct list *iter, *niter;
+		need_client_tidy = 0;
+		for (iter = clients_tab_order; iter; iter = niter) {
+			struct client *c = iter->data;
+			niter = iter->next;
+			if (c->remove)
+				remove_client(c);
 		}
 	}
 }
+
+void event_main_loop(void) {
+	union event ev;
+
+	// Main event loop
+	while (!wm_exit) {
+		if (interruptibleXNextEvent(&ev.xevent))
+			event_dispatch(&ev);
+		tidy_clients();
+	}
+}
+
+// Handle all events already queued or readable for the current display,
+// without blocking.
+
+void event_process_pending(void) {
+	union event ev;
+	while (!wm_exit && XPending(display.dpy)) {
+		XNextEvent(display.dpy, &ev.xevent);
+		event_dispatch(&ev);
+		tidy_clients();
+	}
+}
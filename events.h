@@ -17,9 +17,16 @@ extern int wm_exit;
 // Set by unhandled X errors and unmap requests.
 extern int need_client_tidy;
 
+// Core X event names, indexed by event type.  Extension events are NULL.
+extern const char *const event_names[LASTEvent];
+
 // The main event loop - this will run until something signals the window
 // manager to quit.
 
 void event_main_loop(void);
 
+// Handle any events pending for the current display, without blocking.
+
+void event_process_pending(void);
+
 #endif
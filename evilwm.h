@@ -38,6 +38,10 @@ struct options {
 	// Snap to border flag
 	int snap;
 
+	// Time in milliseconds the pointer must dwell in a window before it
+	// takes focus (0 = immediately)
+	int focusdelay;
+
 	// Whole screen flag (ignore monitor information)
 	int wholescreen;
 
@@ -46,12 +50,53 @@ struct options {
 	int no_solid_drag;
 #endif
 
+	// Remote (high latency) display flag: avoid blocking round trips
+	int remote;
+
+	// Headless (unattended display) flag: no fonts, cursors, colours or
+	// borders, no pointer focus, and new windows always get focus
+	int headless;
+
+	// Kiosk flag: windows matching -app options fill their monitor, and
+	// nothing can be moved or resized with the mouse
+	int kiosk;
+
 	// NULL-terminated array passed to execvp() to launch terminal
 	char **term;
+
+#ifdef CONTROL
+	// Path to control socket
+	char *control;
+#endif
+
+#ifdef STATS
+	// Interval in seconds between publishing statistics (0 = never)
+	int stats;
+#endif
+
+#ifdef TERMPOOL
+	// Number of terminals to launch in advance
+	int termpool;
+#endif
+
+#ifdef LOWLATENCY
+	// Lock and prefault memory
+	int lowlatency;
+
+	// Scheduling priority (nice value; 0 = unchanged)
+	int nice;
+
+	// CPU to run on (-1 = any)
+	int cpu;
+#endif
 };
 
 extern struct options option;
 
+// Focus follows the pointer, and clients can be dragged and resized with the
+// mouse, unless headless or in kiosk mode.
+#define POINTER_CONTROL (!option.headless && !option.kiosk)
+
 #ifndef SOLIDDRAG
 # define option.no_solid_drag 1
 #endif
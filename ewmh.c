@@ -9,6 +9,7 @@
 #endif
 
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <X11/X.h>
@@ -17,15 +18,25 @@
 #include "client.h"
 #include "display.h"
 #include "ewmh.h"
-#include "list.h"
 #include "log.h"
 #include "screen.h"
+#include "stats.h"
 #include "util.h"
+#include "xalloc.h"
 
 // Maintain a reasonably sized allocated block of memory for lists
 // of windows (for feeding to XChangeProperty in one hit).
 static Window *window_array = NULL;
-static Window *alloc_window_array(void);
+static unsigned window_array_size = 0;
+static Window *alloc_window_array(unsigned count);
+
+// Bits recording which _NET_WM_STATE atoms were last written to a client
+#define NET_WM_STATE_MAXIMIZED_VERT (1<<0)
+#define NET_WM_STATE_MAXIMIZED_HORZ (1<<1)
+#define NET_WM_STATE_FULLSCREEN     (1<<2)
+#define NET_WM_STATE_FOCUSED        (1<<3)
+#define NET_WM_STATE_ABOVE          (1<<4)
+#define NET_WM_STATE_BELOW          (1<<5)
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
@@ -47,38 +58,100 @@ void ewmh_set_screen_workarea(struct screen *s) {
 			(unsigned char *)&workarea, 4);
 }
 
+// While a fullscreen client has focus, nobody is looking at a pager, so
+// updates to the client list properties are deferred until it loses focus or
+// leaves fullscreen.  Returns true if the caller should skip its update.
+
+static int defer_client_lists(struct screen *s) {
+	if (current && current->is_fullscreen && current->screen == s) {
+		s->client_lists_stale = 1;
+		return 1;
+	}
+	return 0;
+}
+
+// Write any client list properties deferred by the above, if that no longer
+// applies.
+
+void ewmh_flush_client_lists(struct screen *s) {
+	if (!s->client_lists_stale || defer_client_lists(s))
+		return;
+	s->client_lists_stale = 0;
+	ewmh_set_net_client_list(s);
+	ewmh_set_net_client_list_stacking(s);
+}
+
+// Maintain the list of client windows on a screen in the order they were
+// mapped.  Adding a client only requires appending to _NET_CLIENT_LIST;
+// removing one means it must be rewritten.
+
+void ewmh_client_list_add(struct client *c) {
+	struct screen *s = c->screen;
+	if (s->nclient_list >= s->client_list_size) {
+		s->client_list_size = s->client_list_size ? s->client_list_size * 2 : 16;
+		s->client_list = xrealloc(s->client_list, s->client_list_size * sizeof(Window));
+		STATS_ALLOC(s->client_list_size * sizeof(Window));
+	}
+	s->client_list[s->nclient_list++] = c->window;
+}
+
+void ewmh_client_list_remove(struct client *c) {
+	struct screen *s = c->screen;
+	for (unsigned i = 0; i < s->nclient_list; i++) {
+		if (s->client_list[i] == c->window) {
+			memmove(&s->client_list[i], &s->client_list[i+1],
+			        (s->nclient_list - i - 1) * sizeof(Window));
+			s->nclient_list--;
+			s->client_list_replace = 1;
+			return;
+		}
+	}
+}
+
+// Publish a window list in a root window property: either in full, or by
+// appending whatever has been added since it was last published.
+
+static void publish_window_list(struct screen *s, Atom prop, Window *windows,
+				unsigned n, unsigned *published, int *replace) {
+	if (*replace) {
+		XChangeProperty(display.dpy, s->root, prop,
+				XA_WINDOW, 32, PropModeReplace,
+				(unsigned char *)windows, n);
+	} else if (n > *published) {
+		XChangeProperty(display.dpy, s->root, prop,
+				XA_WINDOW, 32, PropModeAppend,
+				(unsigned char *)(windows + *published), n - *published);
+	}
+	*published = n;
+	*replace = 0;
+}
+
 // Update the _NET_CLIENT_LIST property for a screen.  This is a simple list of
 // all client windows in the order they were mapped.
 
 void ewmh_set_net_client_list(struct screen *s) {
-	Window *windows = alloc_window_array();
-	int i = 0;
-	for (struct list *iter = clients_mapping_order; iter; iter = iter->next) {
-		struct client *c = iter->data;
-		if (c->screen == s) {
-			windows[i++] = c->window;
-		}
-	}
-	XChangeProperty(display.dpy, s->root, X_ATOM(_NET_CLIENT_LIST),
-			XA_WINDOW, 32, PropModeReplace,
-			(unsigned char *)windows, i);
+	if (defer_client_lists(s))
+		return;
+	publish_window_list(s, X_ATOM(_NET_CLIENT_LIST), s->client_list,
+			    s->nclient_list, &s->client_list_published,
+			    &s->client_list_replace);
 }
 
 // Update the _NET_CLIENT_LIST_STACKING property for a screen.  Similar to
 // _NET_CLIENT_LIST, but in stacking order (bottom to top).
 
 void ewmh_set_net_client_list_stacking(struct screen *s) {
-	Window *windows = alloc_window_array();
-	int i = 0;
-	for (struct list *iter = clients_stacking_order; iter; iter = iter->next) {
-		struct client *c = iter->data;
-		if (c->screen == s) {
-			windows[i++] = c->window;
-		}
-	}
-	XChangeProperty(display.dpy, s->root, X_ATOM(_NET_CLIENT_LIST_STACKING),
-			XA_WINDOW, 32, PropModeReplace,
-			(unsigned char *)windows, i);
+	if (defer_client_lists(s))
+		return;
+	// Only the part not yet published need be converted
+	unsigned first = s->stack_replace ? 0 : s->stack_published;
+	if (first >= s->nstack && !s->stack_replace)
+		return;
+	Window *windows = alloc_window_array(s->nstack);
+	for (unsigned i = first; i < s->nstack; i++)
+		windows[i] = s->stack[i]->window;
+	publish_window_list(s, X_ATOM(_NET_CLIENT_LIST_STACKING), windows,
+			    s->nstack, &s->stack_published, &s->stack_replace);
 }
 
 // Update _NET_CURRENT_DESKTOP for screen to currently selected vdesk.
@@ -107,8 +180,8 @@ void ewmh_set_allowed_actions(struct client *c) {
 	};
 	int nelements = sizeof(allowed_actions) / sizeof(Atom);
 	// Omit resize element if resizing not possible:
-	if (c->max_width && c->max_width == c->min_width
-			&& c->max_height && c->max_height == c->min_height)
+	if (c->meta->max_width && c->meta->max_width == c->meta->min_width
+			&& c->meta->max_height && c->meta->max_height == c->meta->min_height)
 		nelements--;
 	XChangeProperty(display.dpy, c->window, X_ATOM(_NET_WM_ALLOWED_ACTIONS),
 			XA_ATOM, 32, PropModeReplace,
@@ -128,6 +201,7 @@ void ewmh_remove_allowed_actions(struct client *c) {
 void ewmh_withdraw_client(struct client *c) {
 	XDeleteProperty(display.dpy, c->window, X_ATOM(_NET_WM_DESKTOP));
 	XDeleteProperty(display.dpy, c->window, X_ATOM(_NET_WM_STATE));
+	c->meta->net_wm_state = 0;
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -162,20 +236,55 @@ unsigned ewmh_get_net_wm_window_type(Window w) {
 	return type;
 }
 
+// Check _NET_WM_STATE property, as set by a client before mapping its window,
+// and build a bitmask of EWMH_WM_STATE_*
+
+unsigned ewmh_get_net_wm_state(Window w) {
+	Atom *aprop;
+	unsigned long nitems, i;
+	unsigned state = 0;
+	if ( (aprop = get_property(w, X_ATOM(_NET_WM_STATE), XA_ATOM, &nitems)) ) {
+		for (i = 0; i < nitems; i++) {
+			if (aprop[i] == X_ATOM(_NET_WM_STATE_ABOVE))
+				state |= EWMH_WM_STATE_ABOVE;
+			if (aprop[i] == X_ATOM(_NET_WM_STATE_BELOW))
+				state |= EWMH_WM_STATE_BELOW;
+		}
+		XFree(aprop);
+	}
+	return state;
+}
+
 // Update _NET_WM_STATE_* properties on a window.  Also updates
 // _NET_ACTIVE_WINDOW on the client's screen if necessary.
 
 void ewmh_set_net_wm_state(struct client *c) {
-	Atom state[4];
+	Atom state[6];
+	unsigned bits = 0;
 	int i = 0;
-	if (c->oldh)
+	if (c->meta->oldh) {
 		state[i++] = X_ATOM(_NET_WM_STATE_MAXIMIZED_VERT);
-	if (c->oldw)
+		bits |= NET_WM_STATE_MAXIMIZED_VERT;
+	}
+	if (c->meta->oldw) {
 		state[i++] = X_ATOM(_NET_WM_STATE_MAXIMIZED_HORZ);
-	if (c->oldh && c->oldw)
+		bits |= NET_WM_STATE_MAXIMIZED_HORZ;
+	}
+	if (c->is_fullscreen) {
 		state[i++] = X_ATOM(_NET_WM_STATE_FULLSCREEN);
+		bits |= NET_WM_STATE_FULLSCREEN;
+	}
+	if (c->is_above) {
+		state[i++] = X_ATOM(_NET_WM_STATE_ABOVE);
+		bits |= NET_WM_STATE_ABOVE;
+	}
+	if (c->is_below) {
+		state[i++] = X_ATOM(_NET_WM_STATE_BELOW);
+		bits |= NET_WM_STATE_BELOW;
+	}
 	if (c == current) {
 		state[i++] = X_ATOM(_NET_WM_STATE_FOCUSED);
+		bits |= NET_WM_STATE_FOCUSED;
 		if (c->screen->active != c->window) {
 			XChangeProperty(display.dpy, c->screen->root,
 			                X_ATOM(_NET_ACTIVE_WINDOW),
@@ -190,9 +299,12 @@ void ewmh_set_net_wm_state(struct client *c) {
 		                (unsigned char *)&w, 1);
 		c->screen->active = None;
 	}
+	if (bits == c->meta->net_wm_state)
+		return;
 	XChangeProperty(display.dpy, c->window, X_ATOM(_NET_WM_STATE),
 			XA_ATOM, 32, PropModeReplace,
 			(unsigned char *)&state, i);
+	c->meta->net_wm_state = bits;
 }
 
 // When we receive _NET_REQUEST_FRAME_EXTENTS from an unmapped window, we are
@@ -210,19 +322,20 @@ void ewmh_set_net_frame_extents(Window w, unsigned long border) {
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-// Allocate/resize an array suitable to hold all client window ids.
+// Allocate/resize an array suitable to hold 'count' window ids.
 //
 // XXX should test that this can be allocated before we commit to managing a
 // window, in the same way that we test the client structure allocation.
 
-static Window *alloc_window_array(void) {
-	unsigned count = 0;
-	for (struct list *iter = clients_mapping_order; iter; iter = iter->next) {
-		count++;
-	}
+static Window *alloc_window_array(unsigned count) {
 	if (count == 0) count++;
-	// Round up to next block of 128
+	// Only ever grow the array, in blocks of 128, so that steady-state
+	// updates don't allocate.
+	if (count <= window_array_size)
+		return window_array;
 	count = (count + 127) & ~127;
 	window_array = realloc(window_array, count * sizeof(Window));
+	STATS_ALLOC(count * sizeof(Window));
+	window_array_size = window_array ? count : 0;
 	return window_array;
 }
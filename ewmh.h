@@ -16,12 +16,19 @@
 #define EWMH_WINDOW_TYPE_DOCK    (1<<1)
 #define EWMH_WINDOW_TYPE_NOTIFICATION (1<<2)
 
+// EWMH window state bits, as read from a window before it is managed
+#define EWMH_WM_STATE_ABOVE (1<<0)
+#define EWMH_WM_STATE_BELOW (1<<1)
+
 struct client;
 struct screen;
 
 void ewmh_set_screen_workarea(struct screen *s);
+void ewmh_client_list_add(struct client *c);
+void ewmh_client_list_remove(struct client *c);
 void ewmh_set_net_client_list(struct screen *s);
 void ewmh_set_net_client_list_stacking(struct screen *s);
+void ewmh_flush_client_lists(struct screen *s);
 void ewmh_set_net_current_desktop(struct screen *s);
 
 void ewmh_set_allowed_actions(struct client *c);
@@ -30,6 +37,7 @@ void ewmh_withdraw_client(struct client *c);
 
 void ewmh_set_net_wm_desktop(struct client *c);
 unsigned ewmh_get_net_wm_window_type(Window w);
+unsigned ewmh_get_net_wm_state(Window w);
 void ewmh_set_net_wm_state(struct client *c);
 void ewmh_set_net_frame_extents(Window w, unsigned long border);
 
@@ -12,12 +12,14 @@
 #include <stdlib.h>
 
 #include "list.h"
+#include "stats.h"
 
 // Wrap data in a new list container
 static struct list *list_new(void *data) {
 	struct list *new = malloc(sizeof(*new));
 	if (!new)
 		return NULL;
+	STATS_LIST_NEW();
 	new->next = NULL;
 	new->data = data;
 	return new;
@@ -66,26 +68,49 @@ struct list *list_delete(struct list *list, void *data) {
 			struct list *elem = *elemp;
 			*elemp = elem->next;
 			free(elem);
+			STATS_LIST_FREE();
 			break;
 		}
 	}
 	return list;
 }
 
-// Move existing list element containing data to head of list
+// Move existing list element containing data to head of list.  The element
+// is relinked, not reallocated.  If not found, data is added.
 struct list *list_to_head(struct list *list, void *data) {
 	if (!data)
 		return list;
-	list = list_delete(list, data);
+	for (struct list **elemp = &list; *elemp; elemp = &(*elemp)->next) {
+		if ((*elemp)->data == data) {
+			struct list *elem = *elemp;
+			*elemp = elem->next;
+			elem->next = list;
+			return elem;
+		}
+	}
 	return list_prepend(list, data);
 }
 
-// Move existing list element containing data to tail of list
+// Move existing list element containing data to tail of list.  The element
+// is relinked, not reallocated.  If not found, data is added.
 struct list *list_to_tail(struct list *list, void *data) {
 	if (!data)
 		return list;
-	list = list_delete(list, data);
-	return list_append(list, data);
+	struct list *elem = NULL;
+	struct list **elemp = &list;
+	while (*elemp) {
+		if (!elem && (*elemp)->data == data) {
+			elem = *elemp;
+			*elemp = elem->next;
+			continue;
+		}
+		elemp = &(*elemp)->next;
+	}
+	if (!elem)
+		return list_append(list, data);
+	elem->next = NULL;
+	*elemp = elem;
+	return list;
 }
 
 // Find list element containing data
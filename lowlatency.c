@@ -0,0 +1,91 @@
+/* evilwm - minimalist window manager for X11
+ * Copyright (C) 1999-2021 Ciaran Anscomb <evilwm@6809.org.uk>
+ * see README for license and other details. */
+
+// Low latency mode.  See lowlatency.h for details.
+
+// CPU affinity is Linux-specific.
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef LOWLATENCY
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "evilwm.h"
+#include "log.h"
+#include "lowlatency.h"
+
+// Amount of stack and heap to prefault
+#define PREFAULT_STACK (256 * 1024)
+#define PREFAULT_HEAP  (1024 * 1024)
+
+// Touch stack pages below the current frame.
+
+static void prefault_stack(void) {
+	volatile unsigned char stack[PREFAULT_STACK];
+	for (size_t i = 0; i < sizeof(stack); i += 4096)
+		stack[i] = 0;
+}
+
+// Grow the heap and keep it: malloc() would otherwise hand memory back to the
+// system, and the next allocation would fault again.
+
+static void prefault_heap(void) {
+#ifdef __GLIBC__
+	mallopt(M_TRIM_THRESHOLD, -1);
+	mallopt(M_MMAP_MAX, 0);
+#endif
+	char *heap = malloc(PREFAULT_HEAP);
+	if (!heap)
+		return;
+	for (size_t i = 0; i < PREFAULT_HEAP; i += 4096)
+		heap[i] = 0;
+	free(heap);
+}
+
+void lowlatency_init(void) {
+	if (option.nice) {
+		if (setpriority(PRIO_PROCESS, 0, option.nice) < 0)
+			LOG_ERROR("can't set priority %d: %s\n", option.nice, strerror(errno));
+	}
+
+	if (option.cpu >= 0) {
+#ifdef __linux__
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(option.cpu, &set);
+		if (sched_setaffinity(0, sizeof(set), &set) < 0)
+			LOG_ERROR("can't set CPU affinity %d: %s\n", option.cpu, strerror(errno));
+#else
+		LOG_ERROR("CPU affinity not supported on this platform\n");
+#endif
+	}
+
+	if (!option.lowlatency)
+		return;
+
+	prefault_heap();
+	prefault_stack();
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+		LOG_ERROR("can't lock memory: %s\n", strerror(errno));
+}
+
+#endif
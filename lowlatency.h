@@ -0,0 +1,18 @@
+/* evilwm - minimalist window manager for X11
+ * Copyright (C) 1999-2021 Ciaran Anscomb <evilwm@6809.org.uk>
+ * see README for license and other details. */
+
+// Low latency mode.
+//
+// With "-lowlatency", evilwm locks its memory so that it can't be paged out,
+// and prefaults stack and heap so that the first drag after a long idle
+// period doesn't stall on page faults.  Optionally, "-nice" and "-cpu" set
+// scheduling priority and CPU affinity.
+
+#ifndef EVILWM_LOWLATENCY_H_
+#define EVILWM_LOWLATENCY_H_
+
+// Apply the requested settings.  Failures are reported but not fatal.
+void lowlatency_init(void);
+
+#endif
@@ -17,11 +17,17 @@
 #include <X11/Xlib.h>
 
 #include "client.h"
+#include "control.h"
 #include "display.h"
 #include "events.h"
 #include "evilwm.h"
 #include "list.h"
 #include "log.h"
+#include "lowlatency.h"
+#include "stats.h"
+#include "termpool.h"
+#include "trace.h"
+#include "util.h"
 #include "xalloc.h"
 #include "xconfig.h"
 
@@ -37,11 +43,19 @@ struct options option = {
 #ifdef SOLIDDRAG
 	.no_solid_drag = 0,
 #endif
+
+#ifdef LOWLATENCY
+	.cpu = -1,
+#endif
 };
 
 static char *opt_grabmask1 = NULL;
 static char *opt_grabmask2 = NULL;
 static char *opt_altmask = NULL;
+#ifdef TRACE
+static char *opt_tracedump = NULL;
+static char *opt_chrometrace = NULL;
+#endif
 
 unsigned numlockmask = 0;
 unsigned grabmask1 = ControlMask|Mod1Mask;
@@ -66,6 +80,10 @@ static struct xconfig_option evilwm_options[] = {
 	{ XCONFIG_INT,      "bw",           { .i = &option.bw } },
 	{ XCONFIG_STR_LIST, "term",         { .sl = &option.term } },
 	{ XCONFIG_INT,      "snap",         { .i = &option.snap } },
+	{ XCONFIG_INT,      "focusdelay",   { .i = &option.focusdelay } },
+	{ XCONFIG_BOOL,     "remote",       { .i = &option.remote } },
+	{ XCONFIG_BOOL,     "headless",     { .i = &option.headless } },
+	{ XCONFIG_BOOL,     "kiosk",        { .i = &option.kiosk } },
 	{ XCONFIG_BOOL,     "wholescreen",  { .i = &option.wholescreen } },
 	{ XCONFIG_STRING,   "mask1",        { .s = &opt_grabmask1 } },
 	{ XCONFIG_STRING,   "mask2",        { .s = &opt_grabmask2 } },
@@ -81,6 +99,24 @@ static struct xconfig_option evilwm_options[] = {
 	{ XCONFIG_CALL_0,   "s",            { .c0 = &set_app_fixed } },
 #ifdef SOLIDDRAG
 	{ XCONFIG_BOOL,     "nosoliddrag",  { .i = &option.no_solid_drag } },
+#endif
+#ifdef CONTROL
+	{ XCONFIG_STRING,   "control",      { .s = &option.control } },
+#endif
+#ifdef STATS
+	{ XCONFIG_INT,      "stats",        { .i = &option.stats } },
+#endif
+#ifdef TERMPOOL
+	{ XCONFIG_INT,      "termpool",     { .i = &option.termpool } },
+#endif
+#ifdef LOWLATENCY
+	{ XCONFIG_BOOL,     "lowlatency",   { .i = &option.lowlatency } },
+	{ XCONFIG_INT,      "nice",         { .i = &option.nice } },
+	{ XCONFIG_INT,      "cpu",          { .i = &option.cpu } },
+#endif
+#ifdef TRACE
+	{ XCONFIG_STRING,   "tracedump",    { .s = &opt_tracedump } },
+	{ XCONFIG_STRING,   "chrometrace",  { .s = &opt_chrometrace } },
 #endif
 	{ XCONFIG_END, NULL, { .i = NULL } }
 };
@@ -93,12 +129,28 @@ static void helptext(void) {
 "usage: evilwm [-display display] [-term termprog] [-fn fontname]\n"
 "              [-fg foreground] [-fc fixed] [-bg background] [-bw borderwidth]\n"
 "              [-mask1 modifiers] [-mask2 modifiers] [-altmask modifiers]\n"
-"              [-snap num] [-numvdesks num] [-wholescreen]\n"
+"              [-snap num] [-numvdesks num] [-wholescreen] [-remote] [-headless]\n"
+"              [-kiosk] [-focusdelay ms]\n"
 "              [-app name/class] [-g geometry] [-dock] [-v vdesk] [-fixed]\n"
 "             "
 #ifdef SOLIDDRAG
 " [-nosoliddrag]"
 #endif
+#ifdef CONTROL
+" [-control socket]"
+#endif
+#ifdef STATS
+" [-stats seconds]"
+#endif
+#ifdef TERMPOOL
+" [-termpool num]"
+#endif
+#ifdef LOWLATENCY
+"\n              [-lowlatency] [-nice num] [-cpu num]"
+#endif
+#ifdef TRACE
+" [-tracedump file] [-chrometrace file]"
+#endif
 " [-V]"
 	);
 }
@@ -107,6 +159,8 @@ int main(int argc, char *argv[]) {
 	struct sigaction act;
 	int argn = 1, ret;
 
+	STATS_STARTUP_BEGIN();
+
 	act.sa_handler = handle_signal;
 	sigemptyset(&act.sa_mask);
 	act.sa_flags = 0;
@@ -152,6 +206,20 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
+#ifdef TRACE
+	// Decoding a trace dump doesn't need a display.
+	if (opt_tracedump)
+		exit(trace_decode(opt_tracedump));
+	trace_init();
+	if (opt_chrometrace)
+		trace_chrome_open(opt_chrometrace);
+#endif
+	TRACE_BEGIN(TRACE_STARTUP, 0);
+
+	// Nothing is drawn on a headless display.
+	if (option.headless)
+		option.bw = 0;
+
 	if (opt_grabmask1)
 		grabmask1 = parse_modifiers(opt_grabmask1);
 	if (opt_grabmask2)
@@ -159,16 +227,55 @@ int main(int argc, char *argv[]) {
 	if (opt_altmask)
 		altmask = parse_modifiers(opt_altmask);
 
+	// Children are reaped from the event loop.
+	spawn_init();
+
 	if (!display.dpy) {
-		// Open display.  Manages all eligible clients across all screens.
-		display_open();
+		// Open displays.  Manages all eligible clients across all screens.
+		display_open(option.display);
 	}
 
+#ifdef CONTROL
+	// Start serving the control socket, if requested.
+	if (option.control)
+		control_open(option.control);
+#endif
+#ifdef STATS
+	stats_init(option.stats);
+#endif
+#ifdef TERMPOOL
+	if (option.termpool > 0)
+		termpool_init(option.termpool);
+#endif
+#ifdef LOWLATENCY
+	// Last, so that everything allocated during startup is locked.
+	lowlatency_init();
+#endif
+
+	// Ready to handle MapRequests.  The trace record's timestamp is the time
+	// taken since trace_init().
+	TRACE_END(TRACE_STARTUP);
+	TRACE_POINT(TRACE_STARTUP, None, 0, 0);
+	STATS_STARTUP_END();
+
 	// Run event look until something signals to quit.
 	wm_exit = 0;
-	event_main_loop();
+	display_main_loop();
+
+#ifdef CONTROL
+	control_close();
+#endif
+#ifdef STATS
+	stats_close();
+#endif
+#ifdef TERMPOOL
+	termpool_close();
+#endif
+#ifdef TRACE
+	trace_chrome_close();
+#endif
 
-	// Close display.  This will cleanly unmanage all windows.
+	// Close displays.  This will cleanly unmanage all windows.
 	display_close();
 
 	return 0;
@@ -29,6 +29,9 @@
 #include "list.h"
 #include "log.h"
 #include "screen.h"
+#include "stack.h"
+#include "stats.h"
+#include "trace.h"
 #include "util.h"
 #include "xalloc.h"
 
@@ -74,13 +77,30 @@ void screen_init(struct screen *s) {
 	// _NET_WM_DESKTOP property of the window with focus when we start to
 	// change this default?
 	s->vdesk = KEY_TO_VDESK(XK_1);
+	s->stack = NULL;
+	s->nstack = s->stack_size = 0;
+	s->docks = NULL;
+	s->docks_size = 0;
+	s->client_list = NULL;
+	s->nclient_list = s->client_list_size = 0;
+	s->client_list_published = s->stack_published = 0;
+	// Replace whatever a previous window manager left behind
+	s->client_list_replace = s->stack_replace = 1;
+	s->mru = xmalloc(option.vdesks * sizeof(struct client *));
+	for (unsigned v = 0; v < option.vdesks; v++)
+		s->mru[v] = NULL;
 
 	// In case the visual for this screen uses a colourmap, ensure our
 	// border colours are in it.
-	XColor dummy;
-	XAllocNamedColor(display.dpy, DefaultColormap(display.dpy, i), option.fg, &s->fg, &dummy);
-	XAllocNamedColor(display.dpy, DefaultColormap(display.dpy, i), option.bg, &s->bg, &dummy);
-	XAllocNamedColor(display.dpy, DefaultColormap(display.dpy, i), option.fc, &s->fc, &dummy);
+	// Headless displays have no borders to colour.
+	if (option.headless) {
+		s->fg.pixel = s->bg.pixel = s->fc.pixel = BlackPixel(display.dpy, i);
+	} else {
+		XColor dummy;
+		XAllocNamedColor(display.dpy, DefaultColormap(display.dpy, i), option.fg, &s->fg, &dummy);
+		XAllocNamedColor(display.dpy, DefaultColormap(display.dpy, i), option.bg, &s->bg, &dummy);
+		XAllocNamedColor(display.dpy, DefaultColormap(display.dpy, i), option.fc, &s->fc, &dummy);
+	}
 
 	// When dragging an outline, we use an inverting graphics context
 	// (GCFunction + GXinvert) so that simply drawing it again will erase
@@ -90,9 +110,9 @@ void screen_init(struct screen *s) {
 	gv.function = GXinvert;
 	gv.subwindow_mode = IncludeInferiors;
 	gv.line_width = 1;  // option.bw
-	gv.font = display.font->fid;
-	s->invert_gc = XCreateGC(display.dpy, s->root,
-				 GCFunction | GCSubwindowMode | GCLineWidth | GCFont, &gv);
+	unsigned long gv_mask = GCFunction | GCSubwindowMode | GCLineWidth;
+	// The font is set when first loaded (see display_font())
+	s->invert_gc = XCreateGC(display.dpy, s->root, gv_mask, &gv);
 
 	// We handle events to the root window:
 	// SubstructureRedirectMask - create, destroy, configure window notifications
@@ -102,7 +122,9 @@ void screen_init(struct screen *s) {
 
 	XSetWindowAttributes attr;
 	attr.event_mask = SubstructureRedirectMask | SubstructureNotifyMask
-	                  | EnterWindowMask | ColormapChangeMask;
+	                  | ColormapChangeMask;
+	if (POINTER_CONTROL)
+		attr.event_mask |= EnterWindowMask;
 	XChangeWindowAttributes(display.dpy, s->root, CWEventMask, &attr);
 
 	// Grab the various keyboard shortcuts
@@ -110,19 +132,25 @@ void screen_init(struct screen *s) {
 
 	s->active = None;
 	s->docks_visible = 1;
+	s->client_lists_stale = 0;
+	s->installed_cmap = None;
 
 	// Scan all the windows on this screen
 	LOG_XENTER("XQueryTree(screen=%d)", i);
 	unsigned nwins;
 	Window dw1, dw2, *wins;
+	TRACE_BEGIN(TRACE_XQUERYTREE, 0);
 	XQueryTree(display.dpy, s->root, &dw1, &dw2, &wins, &nwins);
+	TRACE_END(TRACE_XQUERYTREE);
 	LOG_XDEBUG("%d windows\n", nwins);
 	LOG_XLEAVE();
 
 	// Manage all relevant windows
 	for (unsigned j = 0; j < nwins; j++) {
 		XWindowAttributes winattr;
+		TRACE_BEGIN(TRACE_XGETWINDOWATTRIBUTES, 0);
 		XGetWindowAttributes(display.dpy, wins[j], &winattr);
+		TRACE_END(TRACE_XGETWINDOWATTRIBUTES);
 		// Override redirect implies a pop-up that we should ignore.
 		// If map_state is not IsViewable, it shouldn't be shown right
 		// now, so don't try to manage it.
@@ -157,6 +185,8 @@ void screen_init(struct screen *s) {
 		X_ATOM(_NET_WM_STATE_HIDDEN),
 		X_ATOM(_NET_WM_STATE_FULLSCREEN),
 		X_ATOM(_NET_WM_STATE_FOCUSED),
+		X_ATOM(_NET_WM_STATE_ABOVE),
+		X_ATOM(_NET_WM_STATE_BELOW),
 		X_ATOM(_NET_WM_ALLOWED_ACTIONS),
 
 		// Not sure if it makes any sense including every action here
@@ -220,6 +250,10 @@ void screen_deinit(struct screen *s) {
 	XDeleteProperty(display.dpy, s->root, X_ATOM(_NET_SUPPORTING_WM_CHECK));
 	XDestroyWindow(display.dpy, s->supporting);
 	free(s->monitors);
+	free(s->mru);
+	free(s->stack);
+	free(s->docks);
+	free(s->client_list);
 }
 
 // Get a list of monitors for the screen.  If Randr >= 1.5 is unavailable, or
@@ -241,6 +275,7 @@ void screen_probe_monitors(struct screen *s) {
 				// common uses
 				int n = (nmonitors | 3) + 1;
 				s->monitors = realloc(s->monitors, n * sizeof(struct monitor));
+				STATS_ALLOC(n * sizeof(struct monitor));
 			}
 			for (int i = 0; i < nmonitors; i++) {
 				LOG_XDEBUG("monitor %d: %dx%d+%d+%d\n", i, monitors[i].width, monitors[i].height, monitors[i].x, monitors[i].y);
@@ -287,6 +322,8 @@ void switch_vdesk(struct screen *s, unsigned v) {
 		return;
 
 	LOG_ENTER("switch_vdesk(screen=%d, from=%d, to=%d)", s->screen, s->vdesk, v);
+	TRACE_POINT(TRACE_VDESK, s->root, s->vdesk, v);
+	TRACE_BEGIN2(TRACE_VDESK, s->vdesk, v);
 
 	// If current client is not fixed, deselect it.  An enter event from
 	// mapping clients may select a new one.
@@ -320,6 +357,7 @@ void switch_vdesk(struct screen *s, unsigned v) {
 	ewmh_set_net_current_desktop(s);
 
 	LOG_DEBUG("%d hidden, %d raised\n", nhidden, nraised);
+	TRACE_END(TRACE_VDESK);
 	LOG_LEAVE();
 }
 
@@ -327,29 +365,38 @@ void switch_vdesk(struct screen *s, unsigned v) {
 
 void set_docks_visible(struct screen *s, int is_visible) {
 	LOG_ENTER("set_docks_visible(screen=%d, is_visible=%d)", s->screen, is_visible);
+	TRACE_POINT(TRACE_DOCKS, s->root, is_visible, 0);
 
 	s->docks_visible = is_visible;
 
-	// Traverse client list and hide or show any docks on this screen as
-	// appropriate.
+	// Traverse the stacking order and hide or show any docks on this
+	// screen as appropriate.  Shown docks are collected (keeping their
+	// relative order) and raised together.
 
-	for (struct list *iter = clients_tab_order; iter; iter = iter->next) {
-		struct client *c = iter->data;
-		if (c->screen != s)
-			continue;
+	if (s->nstack > s->docks_size) {
+		s->docks_size = s->nstack;
+		s->docks = xrealloc(s->docks, s->docks_size * sizeof(*s->docks));
+		STATS_ALLOC(s->docks_size * sizeof(*s->docks));
+	}
+	struct client **raise = s->docks;
+	unsigned nraise = 0;
+	for (unsigned i = 0; i < s->nstack; i++) {
+		struct client *c = s->stack[i];
 		if (c->is_dock) {
 			if (is_visible) {
 				// XXX I've assumed that if you want to see
 				// them, you also want them raised...
 				if (is_fixed(c) || (c->vdesk == s->vdesk)) {
 					client_show(c);
-					client_raise(c);
+					raise[nraise++] = c;
 				}
 			} else {
 				client_hide(c);
 			}
 		}
 	}
+	if (stack_raise_group(s, raise, nraise))
+		ewmh_set_net_client_list_stacking(s);
 
 	LOG_LEAVE();
 }
@@ -369,7 +416,8 @@ void set_docks_visible(struct screen *s, int is_visible) {
 //   2) apply screen geometry changes and rescan list of monitors
 //   3) move any client that no longer intersects a monitor to the same
 //      proportional position within its nearest monitor
-//   4) adjust geometry of maximised clients to any "new" monitor
+//   4) adjust geometry of maximised and fullscreen clients to any "new"
+//      monitor
 
 // Record old monitor offset for each client before resize.
 
@@ -384,11 +432,15 @@ void scan_clients_before_resize(struct screen *s) {
 
 		int mw = m->width;
 		int mh = m->height;
-		int cx = c->oldw ? c->oldx : c->x;
-		int cy = c->oldh ? c->oldy : c->y;
+		int cx = c->meta->oldw ? c->meta->oldx : c->x;
+		int cy = c->meta->oldh ? c->meta->oldy : c->y;
+		if (c->is_fullscreen) {
+			cx = c->meta->fs_x;
+			cy = c->meta->fs_y;
+		}
 
-		c->mon_offx = (double)(cx - m->x) / (double)mw;
-		c->mon_offy = (double)(cy - m->y) / (double)mh;
+		c->meta->mon_offx = (double)(cx - m->x) / (double)mw;
+		c->meta->mon_offy = (double)(cy - m->y) / (double)mh;
 	}
 }
 
@@ -403,26 +455,38 @@ void fix_screen_after_resize(struct screen *s) {
 		Bool intersects;
 		struct monitor *m = client_monitor(c, &intersects);
 
-		if (c->oldw) {
+		if (c->is_fullscreen) {
+			// fullscreen: fill the monitor, update restore pos
+			c->x = m->x;
+			c->y = m->y;
+			c->width = m->width;
+			c->height = m->height;
+			c->meta->fs_x = m->x + c->meta->mon_offx * m->width;
+			c->meta->fs_y = m->y + c->meta->mon_offy * m->height;
+			client_moveresize(c);
+			continue;
+		}
+
+		if (c->meta->oldw) {
 			// horiz maximised: update width, update old x pos
 			c->x = m->x - c->border;
 			c->width = m->width;
-			c->oldx = m->x + c->mon_offx * m->width;
+			c->meta->oldx = m->x + c->meta->mon_offx * m->width;
 		} else {
 			// horiz normal: update x pos
 			if (!intersects)
-				c->x = m->x + c->mon_offx * m->width;
+				c->x = m->x + c->meta->mon_offx * m->width;
 		}
 
-		if (c->oldh) {
+		if (c->meta->oldh) {
 			// vert maximised: update height, update old y pos
 			c->y = m->y - c->border;
 			c->height = m->height;
-			c->oldy = m->y + c->mon_offy * m->height;
+			c->meta->oldy = m->y + c->meta->mon_offy * m->height;
 		} else {
 			// vert normal: update y pos
 			if (!intersects)
-				c->y = m->y + c->mon_offy * m->height;
+				c->y = m->y + c->meta->mon_offy * m->height;
 		}
 		client_moveresize(c);
 	}
@@ -448,8 +512,14 @@ struct screen *find_current_screen(void) {
 	int di;  // dummy
 	unsigned dui;  // dummy
 
+	// With only one screen, there's no need to ask.
+	if (display.nscreens == 1)
+		return &display.screens[0];
+
 	// XQueryPointer is useful for getting the current pointer root
+	TRACE_BEGIN(TRACE_XQUERYPOINTER, 0);
 	XQueryPointer(display.dpy, display.screens[0].root, &cur_root, &dw, &di, &di, &di, &di, &dui);
+	TRACE_END(TRACE_XQUERYPOINTER);
 	return find_screen(cur_root);
 }
 
@@ -507,6 +577,8 @@ void grab_keys_for_screen(struct screen *s) {
 		grab_keysym(s->root, grabmask1 | altmask, alt_keys_to_grab[i]);
 	}
 
-	// Only one grab made with only Alt (mask2 option) pressed:
+	// Only one key grabbed with only Alt (mask2 option) pressed, and with
+	// Alt+Shift (mask2+altmask) to cycle in reverse:
 	grab_keysym(s->root, grabmask2, KEY_NEXT);
+	grab_keysym(s->root, grabmask2 | altmask, KEY_NEXT);
 }
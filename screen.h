@@ -37,6 +37,32 @@ struct screen {
 	unsigned vdesk;      // current vdesk for screen
 	unsigned old_vdesk;  // previous vdesk, so user may toggle back to it
 	int docks_visible;   // docks can be toggled visible/hidden
+	int client_lists_stale;  // client list updates deferred (see ewmh.c)
+	Colormap installed_cmap;  // last colourmap we installed
+
+	// Most-recently-used client on each vdesk, heading a ring of all the
+	// clients on that vdesk (including fixed ones)
+	struct client **mru;
+
+	// Clients in stacking order, bottom to top (see stack.c)
+	struct client **stack;
+	unsigned nstack, stack_size;
+
+	// Cached transient group leaders need resolving again (see client.c)
+	int groups_stale;
+
+	// Docks being raised by set_docks_visible(), grown as needed
+	struct client **docks;
+	unsigned docks_size;
+
+	// Client windows in the order they were mapped.  This and the stacking
+	// order are published incrementally (see ewmh.c): the first *_published
+	// entries are already in the root window property, which only needs
+	// rewriting in full when *_replace is set.
+	Window *client_list;
+	unsigned nclient_list, client_list_size;
+	unsigned client_list_published, stack_published;
+	int client_list_replace, stack_replace;
 
 	// from randr, or just one entry with screen dimensions if no randr
 	int nmonitors;       // number of monitors
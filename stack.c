@@ -0,0 +1,238 @@
+/* evilwm - minimalist window manager for X11
+ * Copyright (C) 1999-2021 Ciaran Anscomb <evilwm@6809.org.uk>
+ * see README for license and other details. */
+
+// Stacking order.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include <X11/X.h>
+#include <X11/Xlib.h>
+
+#include "client.h"
+#include "display.h"
+#include "screen.h"
+#include "stack.h"
+#include "stats.h"
+#include "xalloc.h"
+
+// Windows passed to XRestackWindows(), grown as needed
+static Window *restack_windows = NULL;
+static unsigned restack_size = 0;
+
+// Layer a client belongs in, from its current state.
+
+static unsigned stack_layer(struct client *c) {
+	if (c->is_fullscreen && c == current)
+		return LAYER_FULLSCREEN;
+	if (c->is_dock || c->is_notification || c->is_above)
+		return LAYER_ABOVE;
+	if (c->is_below)
+		return LAYER_BELOW;
+	return LAYER_NORMAL;
+}
+
+// Index of a client in its screen's stack, or nstack if not present.  Searches
+// from the top, where recently raised clients are.
+
+static unsigned stack_find(struct screen *s, struct client *c) {
+	for (unsigned i = s->nstack; i > 0; i--) {
+		if (s->stack[i-1] == c)
+			return i - 1;
+	}
+	return s->nstack;
+}
+
+// Index just above the top of a layer, and of the bottom of a layer.
+
+static unsigned layer_top(struct screen *s, unsigned layer) {
+	unsigned i = s->nstack;
+	while (i > 0 && s->stack[i-1]->layer > layer)
+		i--;
+	return i;
+}
+
+static unsigned layer_bottom(struct screen *s, unsigned layer) {
+	unsigned i = 0;
+	while (i < s->nstack && s->stack[i]->layer < layer)
+		i++;
+	return i;
+}
+
+// Anything other than adding a client to the very top means
+// _NET_CLIENT_LIST_STACKING must be rewritten in full rather than appended to.
+
+static void stack_delete(struct screen *s, unsigned i) {
+	memmove(&s->stack[i], &s->stack[i+1], (s->nstack - i - 1) * sizeof(*s->stack));
+	s->nstack--;
+	s->stack_replace = 1;
+}
+
+// There must be room: callers either grow the array or have just deleted.
+
+static void stack_insert(struct screen *s, unsigned i, struct client *c) {
+	memmove(&s->stack[i+1], &s->stack[i], (s->nstack - i) * sizeof(*s->stack));
+	s->stack[i] = c;
+	s->nstack++;
+	if (i + 1 < s->nstack)
+		s->stack_replace = 1;
+}
+
+// Make the X stacking order agree with the client's position in the array,
+// in one request: directly beneath the client above it, or at the very top
+// or bottom.
+
+static void stack_sync(struct screen *s, unsigned i) {
+	struct client *c = s->stack[i];
+	if (i + 1 == s->nstack) {
+		XRaiseWindow(display.dpy, c->parent);
+	} else if (i == 0) {
+		XLowerWindow(display.dpy, c->parent);
+	} else {
+		XWindowChanges wc;
+		wc.sibling = s->stack[i+1]->parent;
+		wc.stack_mode = Below;
+		XConfigureWindow(display.dpy, c->parent, CWSibling|CWStackMode, &wc);
+	}
+}
+
+void stack_add(struct client *c) {
+	struct screen *s = c->screen;
+	if (s->nstack >= s->stack_size) {
+		s->stack_size = s->stack_size ? s->stack_size * 2 : 16;
+		s->stack = xrealloc(s->stack, s->stack_size * sizeof(*s->stack));
+		STATS_ALLOC(s->stack_size * sizeof(*s->stack));
+	}
+	c->layer = stack_layer(c);
+	unsigned i = layer_top(s, c->layer);
+	stack_insert(s, i, c);
+	// The frame was created on top of everything.
+	if (i + 1 < s->nstack)
+		stack_sync(s, i);
+}
+
+void stack_remove(struct client *c) {
+	struct screen *s = c->screen;
+	unsigned i = stack_find(s, c);
+	if (i < s->nstack)
+		stack_delete(s, i);
+}
+
+int stack_raise(struct client *c) {
+	struct screen *s = c->screen;
+	unsigned i = stack_find(s, c);
+	if (i == s->nstack)
+		return 0;
+	unsigned top = layer_top(s, c->layer);
+	if (i + 1 == top)
+		return 0;
+	stack_delete(s, i);
+	stack_insert(s, top - 1, c);
+	stack_sync(s, top - 1);
+	return 1;
+}
+
+int stack_lower(struct client *c) {
+	struct screen *s = c->screen;
+	unsigned i = stack_find(s, c);
+	if (i == s->nstack)
+		return 0;
+	unsigned bottom = layer_bottom(s, c->layer);
+	if (i == bottom)
+		return 0;
+	stack_delete(s, i);
+	stack_insert(s, bottom, c);
+	stack_sync(s, bottom);
+	return 1;
+}
+
+int stack_restack(struct client *c, struct client *sibling, int above) {
+	struct screen *s = c->screen;
+	if (!sibling || sibling->screen != s || sibling->layer != c->layer) {
+		if (sibling && sibling->screen == s)
+			above = sibling->layer > c->layer;
+		return above ? stack_raise(c) : stack_lower(c);
+	}
+	if (sibling == c)
+		return 0;
+	unsigned i = stack_find(s, c);
+	unsigned j = stack_find(s, sibling);
+	if (i == s->nstack || j == s->nstack)
+		return 0;
+	if ((above && i == j + 1) || (!above && i + 1 == j))
+		return 0;
+	stack_delete(s, i);
+	if (j > i)
+		j--;
+	if (above)
+		j++;
+	stack_insert(s, j, c);
+	stack_sync(s, j);
+	return 1;
+}
+
+int stack_raise_group(struct screen *s, struct client **cs, unsigned n) {
+	if (n == 0)
+		return 0;
+	if (n == 1)
+		return stack_raise(cs[0]);
+	unsigned layer = cs[0]->layer;
+	unsigned top = layer_top(s, layer);
+	// Already on top of the layer, in this order?
+	if (n <= top && memcmp(&s->stack[top - n], cs, n * sizeof(*cs)) == 0)
+		return 0;
+
+	unsigned ngroup = 0;
+	for (unsigned j = 0; j < n; j++) {
+		unsigned i = stack_find(s, cs[j]);
+		if (i == s->nstack)
+			continue;
+		stack_delete(s, i);
+		top = layer_top(s, layer);
+		stack_insert(s, top, cs[j]);
+		ngroup++;
+	}
+	if (!ngroup)
+		return 0;
+
+	// The group now occupies stack[top-ngroup+1..top].  XRestackWindows()
+	// takes windows top to bottom and keeps the first where it is, so
+	// lead with whatever is directly above the group and restack it all
+	// in one request.  Only if nothing is above is the topmost raised
+	// first.
+	if (ngroup + 1 > restack_size) {
+		restack_size = ngroup + 1;
+		restack_windows = xrealloc(restack_windows, restack_size * sizeof(Window));
+		STATS_ALLOC(restack_size * sizeof(Window));
+	}
+	unsigned nw = 0;
+	if (top + 1 < s->nstack)
+		restack_windows[nw++] = s->stack[top + 1]->parent;
+	else
+		XRaiseWindow(display.dpy, s->stack[top]->parent);
+	for (unsigned j = 0; j < ngroup; j++)
+		restack_windows[nw++] = s->stack[top - j]->parent;
+	if (nw > 1)
+		XRestackWindows(display.dpy, restack_windows, nw);
+	return 1;
+}
+
+int stack_relayer(struct client *c) {
+	struct screen *s = c->screen;
+	unsigned layer = stack_layer(c);
+	if (layer == c->layer)
+		return 0;
+	unsigned i = stack_find(s, c);
+	c->layer = layer;
+	if (i == s->nstack)
+		return 0;
+	stack_delete(s, i);
+	i = layer_top(s, layer);
+	stack_insert(s, i, c);
+	stack_sync(s, i);
+	return 1;
+}
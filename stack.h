@@ -0,0 +1,50 @@
+/* evilwm - minimalist window manager for X11
+ * Copyright (C) 1999-2021 Ciaran Anscomb <evilwm@6809.org.uk>
+ * see README for license and other details. */
+
+// Stacking order.
+//
+// Each screen keeps its clients in an array, bottom to top, sorted by layer.
+// Raising or lowering a client only moves it within its layer, so docks and
+// other windows kept above stay there without having to fight for it.
+// Requests are only made when the order actually changes, so raising the
+// topmost client of a layer costs nothing, and any single move is one request.
+
+#ifndef EVILWM_STACK_H_
+#define EVILWM_STACK_H_
+
+struct client;
+struct screen;
+
+// Layers, bottom to top.  Stored in a 2-bit field of struct client.
+enum {
+	LAYER_BELOW,       // _NET_WM_STATE_BELOW
+	LAYER_NORMAL,
+	LAYER_ABOVE,       // docks, notifications, _NET_WM_STATE_ABOVE
+	LAYER_FULLSCREEN,  // fullscreen client with focus
+};
+
+// Add a newly managed client on top of its layer, or remove one.
+void stack_add(struct client *c);
+void stack_remove(struct client *c);
+
+// Raise or lower a client within its layer.  Returns non-zero if the order
+// changed.
+int stack_raise(struct client *c);
+int stack_lower(struct client *c);
+
+// Restack a client directly above or below a sibling (as in a
+// ConfigureRequest).  A sibling in another layer is treated as a plain raise
+// or lower.  Returns non-zero if the order changed.
+int stack_restack(struct client *c, struct client *sibling, int above);
+
+// Raise clients on one screen, all in the same layer, to the top of that
+// layer, keeping the order given (bottom to top).  Returns non-zero if the
+// order changed.
+int stack_raise_group(struct screen *s, struct client **cs, unsigned n);
+
+// Move a client to the top of a new layer if any of the flags deciding its
+// layer have changed.  Returns non-zero if the order changed.
+int stack_relayer(struct client *c);
+
+#endif
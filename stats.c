@@ -0,0 +1,299 @@
+/* evilwm - minimalist window manager for X11
+ * Copyright (C) 1999-2021 Ciaran Anscomb <evilwm@6809.org.uk>
+ * see README for license and other details. */
+
+// Runtime statistics.  See stats.h for details.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef STATS
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <X11/X.h>
+#include <X11/Xatom.h>
+#include <X11/Xlib.h>
+
+#include "client.h"
+#include "display.h"
+#include "events.h"
+#include "list.h"
+#include "screen.h"
+#include "stats.h"
+#include "util.h"
+
+// Large enough for every line: see stats_format()
+#define STATS_TEXT_MAX 2048
+
+struct stats stats;
+
+static int stats_interval = 0;
+static unsigned long stats_first_serial;
+
+// Requests made publishing the statistics, which aren't counted in them
+static unsigned long stats_own_requests = 0;
+
+// Server grab state
+static int grab_active = 0;
+static struct timespec grab_start;
+
+// Input event being handled
+static int input_active = 0;
+static Time input_time;
+static struct timespec input_start;
+
+// Server timestamps and our clock have an unknown offset.  The smallest
+// difference seen is taken to be zero latency.
+static int input_offset_known = 0;
+static uint32_t input_offset_min;
+
+// When management of the current new window started, and the round trip
+// count then
+static struct timespec manage_start;
+static unsigned long manage_roundtrips;
+
+// When evilwm started
+static struct timespec startup_start;
+
+// Last text published, to skip publishing when nothing changed
+static char stats_text[STATS_TEXT_MAX];
+static int stats_text_len = 0;
+
+static char stats_filename[256];
+static char stats_tmpname[sizeof(stats_filename) + 4];
+
+void stats_grab(int grabbed) {
+	struct timespec now;
+	if (grabbed) {
+		if (grab_active)
+			return;
+		grab_active = 1;
+		stats.grabs++;
+		clock_gettime(CLOCK_MONOTONIC, &grab_start);
+		return;
+	}
+	if (!grab_active)
+		return;
+	grab_active = 0;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	stats.grab_usec += (now.tv_sec - grab_start.tv_sec) * 1000000
+	                   + (now.tv_nsec - grab_start.tv_nsec) / 1000;
+}
+
+void stats_input_begin(XEvent *e) {
+	switch (e->type) {
+	case KeyPress:
+		input_time = e->xkey.time;
+		break;
+	case ButtonPress:
+		input_time = e->xbutton.time;
+		break;
+	default:
+		input_active = 0;
+		return;
+	}
+	input_active = 1;
+	clock_gettime(CLOCK_MONOTONIC, &input_start);
+}
+
+void stats_input_end(void) {
+	struct timespec now;
+	if (!input_active)
+		return;
+	input_active = 0;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	unsigned long handler_usec = (now.tv_sec - input_start.tv_sec) * 1000000
+	                             + (now.tv_nsec - input_start.tv_nsec) / 1000;
+	if (handler_usec > stats.input_handler_usec_max)
+		stats.input_handler_usec_max = handler_usec;
+
+	// Server time is a 32-bit millisecond count, so work modulo 2^32.
+	uint32_t now_ms = (uint32_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+	uint32_t offset = now_ms - (uint32_t)input_time;
+	if (!input_offset_known || (int32_t)(offset - input_offset_min) < 0) {
+		input_offset_min = offset;
+		input_offset_known = 1;
+	}
+	unsigned long latency = offset - input_offset_min;
+	stats.inputs++;
+	stats.input_latency_ms_total += latency;
+	if (latency > stats.input_latency_ms_max)
+		stats.input_latency_ms_max = latency;
+}
+
+void stats_manage_begin(void) {
+	clock_gettime(CLOCK_MONOTONIC, &manage_start);
+	manage_roundtrips = stats.roundtrips;
+}
+
+// Only called once a window is successfully managed, so windows that vanish
+// part way through aren't counted.
+
+void stats_manage_end(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	unsigned long usec = (now.tv_sec - manage_start.tv_sec) * 1000000
+	                     + (now.tv_nsec - manage_start.tv_nsec) / 1000;
+	stats.manages++;
+	stats.manage_usec_total += usec;
+	if (usec > stats.manage_usec_max)
+		stats.manage_usec_max = usec;
+	unsigned long roundtrips = stats.roundtrips - manage_roundtrips;
+	if (roundtrips > stats.manage_roundtrips_max)
+		stats.manage_roundtrips_max = roundtrips;
+}
+
+void stats_startup_begin(void) {
+	clock_gettime(CLOCK_MONOTONIC, &startup_start);
+}
+
+void stats_startup_end(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	stats.startup_usec = (now.tv_sec - startup_start.tv_sec) * 1000000
+	                     + (now.tv_nsec - startup_start.tv_nsec) / 1000;
+}
+
+// Format the current statistics into buf.  Returns the length.
+
+static int stats_format(char *buf, size_t size) {
+	unsigned long nevents = 0;
+	int nclients = 0;
+	size_t len = 0;
+	struct rusage usage;
+
+	getrusage(RUSAGE_SELF, &usage);
+
+	for (int i = 0; i < LASTEvent; i++)
+		nevents += stats.events[i];
+	for (struct list *iter = clients_tab_order; iter; iter = iter->next)
+		nclients++;
+
+	len += snprintf(buf + len, size - len, "pid %ld\n", (long)getpid());
+	len += snprintf(buf + len, size - len, "events %lu\n", nevents);
+	for (int i = 0; i < LASTEvent && len < size; i++) {
+		if (!stats.events[i])
+			continue;
+		if (event_names[i]) {
+			len += snprintf(buf + len, size - len, "events.%s %lu\n", event_names[i], stats.events[i]);
+		} else {
+			len += snprintf(buf + len, size - len, "events.other %lu\n", stats.events[i]);
+		}
+	}
+	if (len >= size)
+		return size - 1;
+	len += snprintf(buf + len, size - len,
+			"requests %lu\n"
+			"roundtrips %lu\n"
+			"grabs %lu\n"
+			"grab_usec %lu\n"
+			"clients %d\n"
+			"allocations %lu\n"
+			"alloc_bytes %lu\n"
+			"list_nodes %lu\n"
+			"list_nodes_peak %lu\n"
+			"glyph_queries %lu\n"
+			"peak_queue %d\n"
+			"inputs %lu\n"
+			"input_latency_ms_total %lu\n"
+			"input_latency_ms_max %lu\n"
+			"input_handler_usec_max %lu\n"
+			"manages %lu\n"
+			"manage_usec_total %lu\n"
+			"manage_usec_max %lu\n"
+			"manage_roundtrips_max %lu\n"
+			"startup_usec %lu\n"
+			"minor_faults %ld\n"
+			"major_faults %ld\n"
+			"maxrss_kb %ld\n",
+			NextRequest(display.dpy) - stats_first_serial - stats_own_requests,
+			stats.roundtrips, stats.grabs, stats.grab_usec,
+			nclients, stats.allocations, stats.alloc_bytes,
+			stats.list_nodes, stats.list_nodes_peak, stats.glyph_queries,
+			stats.peak_queue,
+			stats.inputs, stats.input_latency_ms_total,
+			stats.input_latency_ms_max, stats.input_handler_usec_max,
+			stats.manages, stats.manage_usec_total, stats.manage_usec_max,
+			stats.manage_roundtrips_max,
+			stats.startup_usec,
+			usage.ru_minflt, usage.ru_majflt, usage.ru_maxrss);
+	if (len >= size)
+		return size - 1;
+	return len;
+}
+
+// Publish statistics if they changed since last time, then schedule the next
+// check.  The file is written under a temporary name and renamed, so readers
+// never see a partial record.
+
+static void stats_publish(void) {
+	char buf[STATS_TEXT_MAX];
+	int len = stats_format(buf, sizeof(buf));
+
+	set_timer(stats_interval * 1000, stats_publish);
+
+	if (len == stats_text_len && memcmp(buf, stats_text, len) == 0)
+		return;
+	memcpy(stats_text, buf, len);
+	stats_text_len = len;
+
+	unsigned long first = NextRequest(display.dpy);
+	for (int i = 0; i < display.nscreens; i++) {
+		XChangeProperty(display.dpy, display.screens[i].root,
+				X_ATOM(_EVILWM_STATS), XA_STRING, 8,
+				PropModeReplace, (unsigned char *)buf, len);
+	}
+	stats_own_requests += NextRequest(display.dpy) - first;
+
+	// The name is predictable if it's under /tmp, so create the file
+	// afresh rather than opening (and following) anything already there.
+	unlink(stats_tmpname);
+	int fd = open(stats_tmpname, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+	if (fd < 0)
+		return;
+	FILE *f = fdopen(fd, "w");
+	if (!f) {
+		close(fd);
+		return;
+	}
+	fwrite(buf, 1, len, f);
+	if (fclose(f) == 0)
+		rename(stats_tmpname, stats_filename);
+}
+
+void stats_init(int interval) {
+	const char *dir = getenv("XDG_RUNTIME_DIR");
+
+	stats_first_serial = NextRequest(display.dpy);
+	if (interval <= 0)
+		return;
+	stats_interval = interval;
+
+	snprintf(stats_filename, sizeof(stats_filename), "%s/evilwm-stats.%ld",
+	         dir ? dir : "/tmp", (long)getpid());
+	snprintf(stats_tmpname, sizeof(stats_tmpname), "%s.tmp", stats_filename);
+	set_timer(stats_interval * 1000, stats_publish);
+}
+
+void stats_close(void) {
+	if (stats_interval <= 0)
+		return;
+	cancel_timer(stats_publish);
+	unlink(stats_filename);
+	for (int i = 0; i < display.nscreens; i++) {
+		XDeleteProperty(display.dpy, display.screens[i].root, X_ATOM(_EVILWM_STATS));
+	}
+	stats_interval = 0;
+}
+
+#endif
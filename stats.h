@@ -0,0 +1,130 @@
+/* evilwm - minimalist window manager for X11
+ * Copyright (C) 1999-2021 Ciaran Anscomb <evilwm@6809.org.uk>
+ * see README for license and other details. */
+
+// Runtime statistics.
+//
+// Counters are maintained throughout, and with "-stats SECONDS" are published
+// at that interval (only when something changed) as text on the
+// _EVILWM_STATS property of each root window and in the file
+// $XDG_RUNTIME_DIR/evilwm-stats.PID.  Each line is a name and a value.  The
+// "requests" line counts X requests made, excluding those publishing the
+// statistics, so that it only changes when evilwm does something.
+// doc/stats-check.sh uses it to count the requests made by common operations.
+
+#ifndef EVILWM_STATS_H_
+#define EVILWM_STATS_H_
+
+#include <X11/X.h>
+#include <X11/Xlib.h>
+
+#ifdef STATS
+
+struct stats {
+	// Events handled by type.  Extension events are counted in [0].
+	unsigned long events[LASTEvent];
+
+	// Blocking round trips to the X server
+	unsigned long roundtrips;
+
+	// Number of server grabs and total time spent grabbed
+	unsigned long grabs;
+	unsigned long grab_usec;
+
+	// Heap allocations made by evilwm itself, and bytes requested.  Memory
+	// Xlib allocates on evilwm's behalf isn't counted: property values from
+	// get_property(), XFetchName() strings, class hints and so on.
+	unsigned long allocations;
+	unsigned long alloc_bytes;
+
+	// List nodes currently allocated, and the most ever allocated at once
+	unsigned long list_nodes;
+	unsigned long list_nodes_peak;
+
+	// Glyphs measured for the window information font (see
+	// display_text_width()).  Each should only ever be measured once.
+	unsigned long glyph_queries;
+
+	// Maximum length of the X event queue seen after handling an event
+	int peak_queue;
+
+	// Key and button presses handled, with the time from the server
+	// timestamping each to evilwm finishing handling it (input latency), and
+	// the time spent handling it.
+	unsigned long inputs;
+	unsigned long input_latency_ms_total;
+	unsigned long input_latency_ms_max;
+	unsigned long input_handler_usec_max;
+
+	// Windows managed, time spent in client_manage_new() doing so, and the
+	// most round trips any one took
+	unsigned long manages;
+	unsigned long manage_usec_total;
+	unsigned long manage_usec_max;
+	unsigned long manage_roundtrips_max;
+
+	// Time from starting up to being ready to handle MapRequests
+	unsigned long startup_usec;
+};
+
+extern struct stats stats;
+
+// Start publishing statistics every 'interval' seconds.
+void stats_init(int interval);
+
+// Stop publishing and remove the stats file.
+void stats_close(void);
+
+// Note the start or end of a server grab.
+void stats_grab(int grabbed);
+
+// Note the start and end of handling an event, to measure input latency.
+void stats_input_begin(XEvent *e);
+void stats_input_end(void);
+
+// Note the start and end of managing a new window.
+void stats_manage_begin(void);
+void stats_manage_end(void);
+
+// Note the start and end of startup.
+void stats_startup_begin(void);
+void stats_startup_end(void);
+
+# define STATS_EVENT(type) (stats.events[((type) < LASTEvent) ? (type) : 0]++)
+# define STATS_QUEUE(n) do { int n_ = (n); if (n_ > stats.peak_queue) stats.peak_queue = n_; } while (0)
+# define STATS_ROUNDTRIP() (stats.roundtrips++)
+# define STATS_ALLOC(size) do { stats.allocations++; stats.alloc_bytes += (size); } while (0)
+# define STATS_LIST_NEW() do { stats.allocations++; stats.alloc_bytes += sizeof(struct list); \
+	if (++stats.list_nodes > stats.list_nodes_peak) stats.list_nodes_peak = stats.list_nodes; } while (0)
+# define STATS_LIST_FREE() (stats.list_nodes--)
+# define STATS_GLYPH_QUERY() (stats.glyph_queries++)
+# define STATS_GRAB() stats_grab(1)
+# define STATS_UNGRAB() stats_grab(0)
+# define STATS_INPUT_BEGIN(e) stats_input_begin(e)
+# define STATS_INPUT_END() stats_input_end()
+# define STATS_MANAGE_BEGIN() stats_manage_begin()
+# define STATS_MANAGE_END() stats_manage_end()
+# define STATS_STARTUP_BEGIN() stats_startup_begin()
+# define STATS_STARTUP_END() stats_startup_end()
+
+#else
+
+# define STATS_EVENT(type) ((void)0)
+# define STATS_QUEUE(n) ((void)0)
+# define STATS_ROUNDTRIP() ((void)0)
+# define STATS_ALLOC(size) ((void)0)
+# define STATS_LIST_NEW() ((void)0)
+# define STATS_LIST_FREE() ((void)0)
+# define STATS_GLYPH_QUERY() ((void)0)
+# define STATS_GRAB() ((void)0)
+# define STATS_UNGRAB() ((void)0)
+# define STATS_INPUT_BEGIN(e) ((void)0)
+# define STATS_INPUT_END() ((void)0)
+# define STATS_MANAGE_BEGIN() ((void)0)
+# define STATS_MANAGE_END() ((void)0)
+# define STATS_STARTUP_BEGIN() ((void)0)
+# define STATS_STARTUP_END() ((void)0)
+
+#endif
+
+#endif
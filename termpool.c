@@ -0,0 +1,207 @@
+/* evilwm - minimalist window manager for X11
+ * Copyright (C) 1999-2021 Ciaran Anscomb <evilwm@6809.org.uk>
+ * see README for license and other details. */
+
+// Terminal pool.  See termpool.h for details.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef TERMPOOL
+
+#include <signal.h>
+#include <sys/types.h>
+
+#include <X11/X.h>
+#include <X11/Xatom.h>
+#include <X11/Xlib.h>
+
+#include "client.h"
+#include "display.h"
+#include "evilwm.h"
+#include "log.h"
+#include "screen.h"
+#include "termpool.h"
+#include "util.h"
+
+// Upper limit on -termpool
+#define TERMPOOL_MAX 8
+
+// Delay before refilling the pool after a terminal is taken, so that the
+// launch doesn't compete with mapping the one just taken.
+#define TERMPOOL_REFILL_MS 250
+
+// A pending terminal that hasn't mapped a window after this long is killed.
+// Terminals that fork or hand off to a server (gnome-terminal, urxvtc,
+// wrapper scripts) never map a window with the PID we know, so each one that
+// fails this way doubles the refill delay, and after TERMPOOL_MAX_FAILURES in
+// a row the pool is given up on.
+#define TERMPOOL_PENDING_MS 10000
+#define TERMPOOL_MAX_FAILURES 3
+
+// A pooled terminal is pending until its window asks to be mapped.
+static struct {
+	pid_t pid;
+	unsigned long spawned;  // monotonic_ms() when launched
+	Window window;  // None while pending
+	Window root;
+	int context;  // display_current() when the window was claimed
+} pool[TERMPOOL_MAX];
+static int npool = 0;
+static int pool_size = 0;
+
+// Consecutive pending terminals that went away without mapping a window
+static int failures = 0;
+
+static void termpool_expire(void);
+
+static void termpool_remove(int i) {
+	pool[i] = pool[--npool];
+}
+
+// Launch terminals until the pool is full.
+
+static void termpool_fill(void) {
+	while (npool < pool_size) {
+		pid_t pid = spawn((const char *const *)option.term);
+		if (pid <= 0)
+			break;
+		pool[npool].pid = pid;
+		pool[npool].spawned = monotonic_ms();
+		pool[npool].window = None;
+		pool[npool].root = None;
+		npool++;
+		set_timer(TERMPOOL_PENDING_MS, termpool_expire);
+	}
+}
+
+// Schedule a refill.  After a pending terminal failed, back off, or give up
+// entirely if that keeps happening.
+
+static void termpool_refill(int failed) {
+	if (!pool_size)
+		return;
+	if (!failed) {
+		set_timer(TERMPOOL_REFILL_MS, termpool_fill);
+		return;
+	}
+	if (++failures >= TERMPOOL_MAX_FAILURES) {
+		LOG_ERROR("termpool: terminals aren't mapping windows with their own PID, disabling pool\n");
+		termpool_close();
+		return;
+	}
+	set_timer(TERMPOOL_REFILL_MS << failures, termpool_fill);
+}
+
+// Kill pending terminals that have had long enough to map a window.  Their
+// exit is then handled as a failure by termpool_child_exited().
+
+static void termpool_expire(void) {
+	unsigned long now = monotonic_ms();
+	unsigned long next = 0;
+	for (int i = 0; i < npool; i++) {
+		if (pool[i].window != None)
+			continue;
+		unsigned long age = now - pool[i].spawned;
+		if (age >= TERMPOOL_PENDING_MS) {
+			LOG_DEBUG("termpool: pid %ld never mapped a window\n", (long)pool[i].pid);
+			kill(pool[i].pid, SIGTERM);
+		} else if (!next || TERMPOOL_PENDING_MS - age < next) {
+			next = TERMPOOL_PENDING_MS - age;
+		}
+	}
+	if (next)
+		set_timer(next, termpool_expire);
+}
+
+void termpool_init(int size) {
+	if (size > TERMPOOL_MAX)
+		size = TERMPOOL_MAX;
+	pool_size = size;
+	termpool_fill();
+}
+
+void termpool_close(void) {
+	cancel_timer(termpool_fill);
+	cancel_timer(termpool_expire);
+	for (int i = 0; i < npool; i++)
+		kill(pool[i].pid, SIGTERM);
+	npool = 0;
+	pool_size = 0;
+}
+
+int termpool_claim(Window w, Window root) {
+	int npending = 0;
+	for (int i = 0; i < npool; i++) {
+		if (pool[i].window == None)
+			npending++;
+	}
+	// Only query the window's PID if we're expecting one of ours.
+	if (!npending)
+		return 0;
+
+	unsigned long nitems;
+	long *pid = get_property(w, X_ATOM(_NET_WM_PID), XA_CARDINAL, &nitems);
+	if (!pid)
+		return 0;
+	int claimed = 0;
+	if (nitems > 0) {
+		for (int i = 0; i < npool; i++) {
+			if (pool[i].window == None && pool[i].pid == (pid_t)pid[0]) {
+				LOG_DEBUG("termpool: holding window %lx (pid %ld)\n", (unsigned long)w, pid[0]);
+				pool[i].window = w;
+				pool[i].root = root;
+				pool[i].context = display_current();
+				failures = 0;
+				claimed = 1;
+				break;
+			}
+		}
+	}
+	XFree(pid);
+	return claimed;
+}
+
+void termpool_forget(Window w) {
+	for (int i = 0; i < npool; i++) {
+		if (pool[i].window == w && pool[i].context == display_current()) {
+			termpool_remove(i);
+			termpool_refill(0);
+			return;
+		}
+	}
+}
+
+void termpool_child_exited(pid_t pid) {
+	for (int i = 0; i < npool; i++) {
+		if (pool[i].pid == pid) {
+			// A terminal that exits after mapping its window is
+			// simply replaced.  One that exits before then has
+			// probably handed off to another process.
+			int failed = (pool[i].window == None);
+			termpool_remove(i);
+			termpool_refill(failed);
+			return;
+		}
+	}
+}
+
+int termpool_take(struct screen *s) {
+	int context = display_current();
+	for (int i = 0; i < npool; i++) {
+		if (pool[i].window == None || pool[i].context != context)
+			continue;
+		if (!s || pool[i].root == s->root) {
+			Window w = pool[i].window;
+			Window root = pool[i].root;
+			termpool_remove(i);
+			client_manage_new(w, find_screen(root));
+			set_timer(TERMPOOL_REFILL_MS, termpool_fill);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+#endif
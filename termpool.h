@@ -0,0 +1,41 @@
+/* evilwm - minimalist window manager for X11
+ * Copyright (C) 1999-2021 Ciaran Anscomb <evilwm@6809.org.uk>
+ * see README for license and other details. */
+
+// Terminal pool.
+//
+// With "-termpool N", evilwm keeps up to N terminals launched in advance.
+// Their windows are recognised by _NET_WM_PID when they first ask to be
+// mapped, and are then held unmapped and unmanaged.  KEY_NEW manages and maps
+// one of these immediately instead of waiting for a new terminal to start,
+// and the pool is refilled afterwards.
+
+#ifndef EVILWM_TERMPOOL_H_
+#define EVILWM_TERMPOOL_H_
+
+#include <sys/types.h>
+
+#include <X11/X.h>
+
+struct screen;
+
+// Fill the pool up to 'size' terminals.
+void termpool_init(int size);
+
+// Terminate any pooled terminals not yet taken.
+void termpool_close(void);
+
+// Called for map requests from unmanaged windows.  Returns non-zero if the
+// window belongs to a pooled terminal, in which case it is now held.
+int termpool_claim(Window w, Window root);
+
+// Forget a pooled window that has been destroyed, or a pooled terminal whose
+// process has exited.
+void termpool_forget(Window w);
+void termpool_child_exited(pid_t pid);
+
+// Manage and map a pooled terminal on the specified screen.  Returns zero if
+// none is ready, in which case the caller should spawn one instead.
+int termpool_take(struct screen *s);
+
+#endif
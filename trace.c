@@ -0,0 +1,309 @@
+/* evilwm - minimalist window manager for X11
+ * Copyright (C) 1999-2021 Ciaran Anscomb <evilwm@6809.org.uk>
+ * see README for license and other details. */
+
+// Trace buffer.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef TRACE
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <X11/X.h>
+#include <X11/Xlib.h>
+
+#include "client.h"
+#include "display.h"
+#include "events.h"
+#include "list.h"
+#include "log.h"
+#include "trace.h"
+
+// Number of records held.  Must be a power of two.
+#define TRACE_SIZE 2048
+
+#define TRACE_MAGIC "EVWT"
+#define TRACE_VERSION 2
+
+struct trace_record {
+	uint64_t time;    // nanoseconds since trace_init()
+	uint32_t id;
+	uint32_t window;
+	uint32_t serial;
+	int32_t a, b;
+};
+
+struct trace_header {
+	char magic[4];
+	uint32_t version;
+	uint32_t size;    // number of records following
+	uint32_t head;    // total records ever made
+};
+
+// Names of trace points, and of their two arguments.  Reflect any changes
+// here in the enum in trace.h.
+static const struct {
+	const char *name;
+	const char *a;
+	const char *b;
+} trace_names[NUM_TRACE_IDS] = {
+	[TRACE_EVENT]    = { "event", "type", NULL },
+	[TRACE_MANAGE]   = { "client_manage_new", "screen", NULL },
+	[TRACE_REMOVE]   = { "remove_client", "withdrawing", NULL },
+	[TRACE_SELECT]   = { "select_client", NULL, NULL },
+	[TRACE_RAISE]    = { "client_raise", NULL, NULL },
+	[TRACE_LOWER]    = { "client_lower", NULL, NULL },
+	[TRACE_VDESK]    = { "switch_vdesk", "from", "to" },
+	[TRACE_TO_VDESK] = { "client_to_vdesk", "vdesk", NULL },
+	[TRACE_MAXIMISE] = { "client_maximise", "action", "hv" },
+	[TRACE_DRAG]     = { "client_move_drag", "x", "y" },
+	[TRACE_SWEEP]    = { "client_resize_sweep", "width", "height" },
+	[TRACE_DOCKS]    = { "set_docks_visible", "is_visible", NULL },
+	[TRACE_SPAWN]    = { "spawn", NULL, NULL },
+	[TRACE_XERROR]   = { "handle_xerror", "error", "request" },
+	[TRACE_MOTION]   = { "motion", NULL, NULL },
+	[TRACE_STARTUP]  = { "startup", NULL, NULL },
+	[TRACE_XSYNC]    = { "XSync", NULL, NULL },
+	[TRACE_XQUERYPOINTER] = { "XQueryPointer", NULL, NULL },
+	[TRACE_XGETWINDOWATTRIBUTES] = { "XGetWindowAttributes", NULL, NULL },
+	[TRACE_XGETPROPERTY] = { "XGetWindowProperty", "property", NULL },
+	[TRACE_XGETWMNORMALHINTS] = { "XGetWMNormalHints", NULL, NULL },
+	[TRACE_XFETCHNAME] = { "XFetchName", NULL, NULL },
+	[TRACE_XGETCLASSHINT] = { "XGetClassHint", NULL, NULL },
+	[TRACE_XGETWMPROTOCOLS] = { "XGetWMProtocols", NULL, NULL },
+	[TRACE_XQUERYTREE] = { "XQueryTree", NULL, NULL },
+	[TRACE_XGRABPOINTER] = { "XGrabPointer", NULL, NULL },
+	[TRACE_XGRABKEYBOARD] = { "XGrabKeyboard", NULL, NULL },
+	[TRACE_XGETGEOMETRY] = { "XGetGeometry", NULL, NULL },
+	[TRACE_XGETTRANSIENTFORHINT] = { "XGetTransientForHint", NULL, NULL },
+	[TRACE_XQUERYTEXTEXTENTS] = { "XQueryTextExtents", NULL, NULL },
+};
+
+static struct trace_record trace_buffer[TRACE_SIZE];
+static uint32_t trace_head = 0;
+static struct timespec trace_epoch;
+
+// Dump file name is fixed at startup, as it is needed from signal handlers.
+static char trace_filename[256];
+
+// Chrome trace event output
+static FILE *chrome_file = NULL;
+static const char *chrome_separator = "";
+
+// Nanoseconds since trace_init()
+
+static uint64_t trace_now(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)(now.tv_sec - trace_epoch.tv_sec) * 1000000000
+	       + now.tv_nsec - trace_epoch.tv_nsec;
+}
+
+// Add a record to the ring buffer.
+
+void trace_record(enum trace_id id, Window w, unsigned long serial, long a, long b) {
+	struct trace_record *r = &trace_buffer[trace_head++ & (TRACE_SIZE - 1)];
+	r->time = trace_now();
+	r->id = id;
+	r->window = w;
+	r->serial = serial;
+	r->a = a;
+	r->b = b;
+}
+
+// Write the buffer to the dump file.  Only uses async-signal-safe functions.
+
+static void trace_dump(void) {
+	struct trace_header header = {
+		.magic = TRACE_MAGIC,
+		.version = TRACE_VERSION,
+		.size = TRACE_SIZE,
+		.head = trace_head,
+	};
+	// The name is predictable if it's under /tmp, so never follow a symlink
+	// someone else planted there.
+	int fd = open(trace_filename, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0600);
+	if (fd < 0)
+		return;
+	ssize_t r = write(fd, &header, sizeof(header));
+	r = write(fd, trace_buffer, sizeof(trace_buffer));
+	(void)r;
+	close(fd);
+}
+
+static void handle_dump_signal(int signo) {
+	(void)signo;
+	trace_dump();
+}
+
+// On a crash, dump the buffer then let the default action happen (the
+// handler was installed with SA_RESETHAND).
+
+static void handle_crash_signal(int signo) {
+	trace_dump();
+	raise(signo);
+}
+
+// Install signal handlers and choose the dump file name.
+
+void trace_init(void) {
+	static const int crash_signals[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+	struct sigaction act;
+	const char *dir = getenv("XDG_RUNTIME_DIR");
+
+	clock_gettime(CLOCK_MONOTONIC, &trace_epoch);
+
+	snprintf(trace_filename, sizeof(trace_filename), "%s/evilwm-trace.%ld",
+	         dir ? dir : "/tmp", (long)getpid());
+
+	act.sa_handler = handle_dump_signal;
+	sigemptyset(&act.sa_mask);
+	act.sa_flags = SA_RESTART;
+	sigaction(SIGUSR1, &act, NULL);
+
+	act.sa_handler = handle_crash_signal;
+	act.sa_flags = SA_RESETHAND;
+	for (unsigned i = 0; i < sizeof(crash_signals) / sizeof(crash_signals[0]); i++) {
+		sigaction(crash_signals[i], &act, NULL);
+	}
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+// Chrome trace event output.  Each record is one JSON object in a top-level
+// array; timestamps are in microseconds.
+
+int trace_chrome_open(const char *filename) {
+	chrome_file = fopen(filename, "w");
+	if (!chrome_file) {
+		LOG_ERROR("can't open trace file %s\n", filename);
+		return 0;
+	}
+	// Don't leak it into spawned processes.
+	fcntl(fileno(chrome_file), F_SETFD, FD_CLOEXEC);
+	fputs("[", chrome_file);
+	chrome_separator = "\n";
+	return 1;
+}
+
+void trace_chrome_close(void) {
+	if (!chrome_file)
+		return;
+	fputs("\n]\n", chrome_file);
+	fclose(chrome_file);
+	chrome_file = NULL;
+}
+
+// Write the common start of a trace event object.
+
+static void chrome_event_start(const char *phase) {
+	uint64_t t = trace_now();
+	fprintf(chrome_file, "%s{\"ph\":\"%s\",\"ts\":%lu.%03u,\"pid\":%ld,\"tid\":1",
+	        chrome_separator, phase,
+	        (unsigned long)(t / 1000), (unsigned)(t % 1000),
+	        (long)getpid());
+	chrome_separator = ",\n";
+}
+
+void trace_begin(enum trace_id id, long a, long b) {
+	if (!chrome_file)
+		return;
+	chrome_event_start("B");
+	if (id == TRACE_EVENT) {
+		if (a >= 0 && a < LASTEvent && event_names[a]) {
+			fprintf(chrome_file, ",\"cat\":\"event\",\"name\":\"%s\"}", event_names[a]);
+		} else {
+			fprintf(chrome_file, ",\"cat\":\"event\",\"name\":\"event %ld\"}", a);
+		}
+		return;
+	}
+	fprintf(chrome_file, ",\"cat\":\"%s\",\"name\":\"%s\"",
+	        (id >= TRACE_ROUNDTRIP_FIRST) ? "x11" : "wm", trace_names[id].name);
+	if (trace_names[id].a) {
+		fprintf(chrome_file, ",\"args\":{\"%s\":%ld", trace_names[id].a, a);
+		if (trace_names[id].b) {
+			fprintf(chrome_file, ",\"%s\":%ld", trace_names[id].b, b);
+		}
+		fputs("}", chrome_file);
+	}
+	fputs("}", chrome_file);
+}
+
+void trace_end(void) {
+	if (!chrome_file)
+		return;
+	chrome_event_start("E");
+	fputs("}", chrome_file);
+}
+
+void trace_counters(void) {
+	if (!chrome_file)
+		return;
+	int nclients = 0;
+	for (struct list *iter = clients_tab_order; iter; iter = iter->next)
+		nclients++;
+	chrome_event_start("C");
+	fprintf(chrome_file, ",\"name\":\"wm\",\"args\":{\"clients\":%d,\"queue\":%d}}",
+	        nclients, XQLength(display.dpy));
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+// Decode a dump file to stdout, oldest record first.
+
+int trace_decode(const char *filename) {
+	struct trace_header header;
+	FILE *f = fopen(filename, "rb");
+	if (!f) {
+		LOG_ERROR("can't open trace file %s\n", filename);
+		return 1;
+	}
+	if (fread(&header, sizeof(header), 1, f) != 1
+	    || memcmp(header.magic, TRACE_MAGIC, 4) != 0
+	    || header.version != TRACE_VERSION
+	    || header.size != TRACE_SIZE) {
+		LOG_ERROR("%s: not a trace file from this version of evilwm\n", filename);
+		fclose(f);
+		return 1;
+	}
+	if (fread(trace_buffer, sizeof(trace_buffer), 1, f) != 1) {
+		LOG_ERROR("%s: truncated trace file\n", filename);
+		fclose(f);
+		return 1;
+	}
+	fclose(f);
+
+	uint32_t first = (header.head > TRACE_SIZE) ? header.head - TRACE_SIZE : 0;
+	for (uint32_t i = first; i != header.head; i++) {
+		struct trace_record *r = &trace_buffer[i & (TRACE_SIZE - 1)];
+		if (r->id >= NUM_TRACE_IDS)
+			continue;
+		printf("%5lu.%06lu %8lu  %s(window=%lx",
+		       (unsigned long)(r->time / 1000000000),
+		       (unsigned long)(r->time / 1000) % 1000000,
+		       (unsigned long)r->serial, trace_names[r->id].name,
+		       (unsigned long)r->window);
+		if (r->id == TRACE_EVENT && r->a >= 0 && r->a < LASTEvent && event_names[r->a]) {
+			printf(", type=%s", event_names[r->a]);
+		} else if (trace_names[r->id].a) {
+			printf(", %s=%ld", trace_names[r->id].a, (long)r->a);
+		}
+		if (trace_names[r->id].b) {
+			printf(", %s=%ld", trace_names[r->id].b, (long)r->b);
+		}
+		printf(")\n");
+	}
+	return 0;
+}
+
+#endif
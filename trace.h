@@ -0,0 +1,120 @@
+/* evilwm - minimalist window manager for X11
+ * Copyright (C) 1999-2021 Ciaran Anscomb <evilwm@6809.org.uk>
+ * see README for license and other details. */
+
+// Trace buffer.
+//
+// A fixed-size ring buffer of compact binary records, cheap enough to leave
+// enabled in release builds.  The buffer is written to a file on SIGUSR1 or
+// when evilwm crashes, and "evilwm -tracedump FILE" decodes such a file.
+//
+// Unlike the LOG_DEBUG() family of macros, nothing is formatted at the time a
+// record is made; that happens offline when decoding.
+//
+// For profiling, "-chrometrace FILE" additionally writes nested spans (event
+// dispatch, major operations and blocking X round trips) and counters to FILE
+// in Chrome's trace event JSON format, for loading into a trace viewer.
+
+#ifndef EVILWM_TRACE_H_
+#define EVILWM_TRACE_H_
+
+#include <X11/X.h>
+#include <X11/Xlib.h>
+
+#include "stats.h"
+
+// Trace points.  Reflect any changes here in trace_names[] in trace.c.
+enum trace_id {
+	TRACE_EVENT,      // X event dispatched: a = event type
+	TRACE_MANAGE,     // client_manage_new(): a = screen
+	TRACE_REMOVE,     // remove_client(): a = withdrawing
+	TRACE_SELECT,     // select_client()
+	TRACE_RAISE,      // client_raise()
+	TRACE_LOWER,      // client_lower()
+	TRACE_VDESK,      // switch_vdesk(): a = from, b = to
+	TRACE_TO_VDESK,   // client_to_vdesk(): a = vdesk
+	TRACE_MAXIMISE,   // client_maximise(): a = action, b = flags
+	TRACE_DRAG,       // client_move_drag() finished: a = x, b = y
+	TRACE_SWEEP,      // client_resize_sweep() finished: a = width, b = height
+	TRACE_DOCKS,      // set_docks_visible(): a = visible
+	TRACE_SPAWN,      // spawn()
+	TRACE_XERROR,     // handle_xerror(): a = error code, b = request code
+	TRACE_MOTION,     // span: one drag or sweep motion step
+	TRACE_STARTUP,    // span: startup, until ready to handle MapRequests
+
+	// Blocking X round trips, traced as spans only
+	TRACE_XSYNC,
+	TRACE_XQUERYPOINTER,
+	TRACE_XGETWINDOWATTRIBUTES,
+	TRACE_XGETPROPERTY,  // a = property atom
+	TRACE_XGETWMNORMALHINTS,
+	TRACE_XFETCHNAME,
+	TRACE_XGETCLASSHINT,
+	TRACE_XGETWMPROTOCOLS,
+	TRACE_XQUERYTREE,
+	TRACE_XGRABPOINTER,
+	TRACE_XGRABKEYBOARD,
+	TRACE_XGETGEOMETRY,
+	TRACE_XGETTRANSIENTFORHINT,
+	TRACE_XQUERYTEXTEXTENTS,
+
+	NUM_TRACE_IDS
+};
+
+#define TRACE_ROUNDTRIP_FIRST TRACE_XSYNC
+
+// Round trips are counted for statistics at the points they are traced.
+#define TRACE_COUNT_ROUNDTRIP(id) do { if ((id) >= TRACE_ROUNDTRIP_FIRST) STATS_ROUNDTRIP(); } while (0)
+
+#ifdef TRACE
+
+// Install signal handlers and choose the dump file name.
+void trace_init(void);
+
+// Add a record to the ring buffer.
+void trace_record(enum trace_id id, Window w, unsigned long serial, long a, long b);
+
+// Decode a dump file to stdout.  Returns an exit status.
+int trace_decode(const char *filename);
+
+// Start or finish writing spans to a Chrome trace event file.
+int trace_chrome_open(const char *filename);
+void trace_chrome_close(void);
+
+// Begin and end a span.  Spans must nest.  Does nothing unless a Chrome trace
+// file is open.
+void trace_begin(enum trace_id id, long a, long b);
+void trace_end(void);
+
+// Emit counters (client count, X event queue length).
+void trace_counters(void);
+
+// Trace an X event about to be dispatched.
+# define TRACE_XEVENT(e) trace_record(TRACE_EVENT, (e)->xany.window, (e)->xany.serial, (e)->type, 0)
+
+// Trace an action.  The serial recorded is that of the next X request.
+# define TRACE_POINT(id, w, a, b) trace_record((id), (w), NextRequest(display.dpy), (a), (b))
+
+// Trace an action related to a specific X request serial.
+# define TRACE_SERIAL(id, w, serial, a, b) trace_record((id), (w), (serial), (a), (b))
+
+// Spans.  TRACE_BEGIN2() also records a second argument, for trace points
+// that name one.  The id passed to TRACE_END() is only there to aid the reader.
+# define TRACE_BEGIN(id, a) TRACE_BEGIN2(id, a, 0)
+# define TRACE_BEGIN2(id, a, b) do { TRACE_COUNT_ROUNDTRIP(id); trace_begin((id), (a), (b)); } while (0)
+# define TRACE_END(id) trace_end()
+# define TRACE_COUNTERS() trace_counters()
+
+#else
+
+# define TRACE_XEVENT(e)
+# define TRACE_POINT(id, w, a, b)
+# define TRACE_SERIAL(id, w, serial, a, b)
+# define TRACE_BEGIN(id, a) TRACE_COUNT_ROUNDTRIP(id)
+# define TRACE_BEGIN2(id, a, b) TRACE_COUNT_ROUNDTRIP(id)
+# define TRACE_END(id)
+# define TRACE_COUNTERS()
+
+#endif
+
+#endif
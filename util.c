@@ -9,10 +9,15 @@
 #endif
 
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <spawn.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/select.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <X11/X.h>
@@ -22,41 +27,152 @@
 #include "client.h"
 #include "display.h"
 #include "events.h"
+#include "evilwm.h"
 #include "log.h"
 #include "screen.h"
+#include "termpool.h"
+#include "trace.h"
 #include "util.h"
+#include "xalloc.h"
+
+extern char **environ;
 
 // For get_property()
 #define MAXIMUM_PROPERTY_LENGTH 4096
 
+// Maximum number of pending timers
+#define MAX_TIMERS 8
+
 // Error handler interaction
 int ignore_xerror = 0;
 volatile Window initialising = None;
 
-// Spawn a subprocess by fork()ing twice so we don't have to worry about
-// SIGCHLDs.
+// Extra file descriptors watched alongside the X connection
+static struct {
+	int fd;
+	void (*handler)(int fd);
+} *watched_fds = NULL;
+static int nwatched_fds = 0;
+static int watched_fds_size = 0;
+
+// Pending timers.  Deadlines are in milliseconds on the monotonic clock.
+static struct {
+	unsigned long deadline;
+	void (*handler)(void);
+} timers[MAX_TIMERS];
+static int ntimers = 0;
+
+// Self-pipe written to by the SIGCHLD handler, so that children are reaped
+// from the main loop.
+static int sigchld_pipe[2] = { -1, -1 };
+
+static void handle_sigchld(int signo) {
+	(void)signo;
+	int saved_errno = errno;
+	ssize_t r = write(sigchld_pipe[1], "", 1);
+	(void)r;
+	errno = saved_errno;
+}
 
-void spawn(const char *const cmd[]) {
-	struct screen *current_screen = find_current_screen();
+static void reap_children(int fd) {
+	char buf[64];
 	pid_t pid;
+	while (read(fd, buf, sizeof(buf)) > 0)
+		;
+	while ((pid = waitpid(-1, NULL, WNOHANG)) > 0) {
+#ifdef TERMPOOL
+		termpool_child_exited(pid);
+#endif
+	}
+}
 
-	if (current_screen && current_screen->display)
-		putenv(current_screen->display);
-	if (!(pid = fork())) {
-		// Put first fork in a new session
-		setsid();
-		switch (fork()) {
-			// execvp()'s prototype is (char *const *) suggesting that it
-			// modifies the contents of the strings.  The prototype is this
-			// way due to SUS maintaining compatability with older code.
-			// However, execvp guarantees not to modify argv, so the following
-			// cast is valid.
-			case 0: execvp(cmd[0], (char *const *)cmd); break;
-			default: _exit(0);
-		}
+// Arrange for spawned children to be reaped.  If the self-pipe can't be
+// created, fall back to having the system discard them.
+
+void spawn_init(void) {
+	struct sigaction act;
+	sigemptyset(&act.sa_mask);
+	if (pipe(sigchld_pipe) < 0) {
+		LOG_ERROR("spawn_init(): can't create pipe\n");
+		act.sa_handler = SIG_IGN;
+		act.sa_flags = SA_NOCLDWAIT;
+		sigaction(SIGCHLD, &act, NULL);
+		return;
 	}
-	if (pid > 0)
-		wait(NULL);
+	for (int i = 0; i < 2; i++) {
+		fcntl(sigchld_pipe[i], F_SETFD, FD_CLOEXEC);
+		fcntl(sigchld_pipe[i], F_SETFL, O_NONBLOCK);
+	}
+	watch_fd(sigchld_pipe[0], reap_children);
+	act.sa_handler = handle_sigchld;
+	act.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+	sigaction(SIGCHLD, &act, NULL);
+}
+
+// Copy the environment for a child, with DISPLAY set to 'display' (a
+// "DISPLAY=..." string) if it's not NULL.  evilwm's own environment is left
+// alone: it may manage several displays, and the string may be freed while
+// it's still running.  Free the result with free().
+
+static char **spawn_environ(char *display_var) {
+	size_t n = 0;
+	while (environ[n])
+		n++;
+	char **envp = xmalloc((n + 2) * sizeof(*envp));
+	size_t j = 0;
+	for (size_t i = 0; i < n; i++) {
+		if (display_var && strncmp(environ[i], "DISPLAY=", 8) == 0)
+			continue;
+		envp[j++] = environ[i];
+	}
+	if (display_var)
+		envp[j++] = display_var;
+	envp[j] = NULL;
+	return envp;
+}
+
+// Spawn a subprocess with posix_spawnp(), in its own session where supported
+// (or else its own process group).  Children are reaped asynchronously by
+// reap_children().  Returns the child's PID, or -1 on failure.
+
+pid_t spawn(const char *const cmd[]) {
+	struct screen *current_screen = find_current_screen();
+	posix_spawnattr_t attr;
+	sigset_t no_signals, default_signals;
+	short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+	pid_t pid;
+	int err;
+
+	TRACE_POINT(TRACE_SPAWN, None, 0, 0);
+
+	char **envp = spawn_environ(current_screen ? current_screen->display : NULL);
+
+	posix_spawnattr_init(&attr);
+	sigemptyset(&no_signals);
+	posix_spawnattr_setsigmask(&attr, &no_signals);
+	// If spawn_init() fell back to ignoring SIGCHLD, children would inherit
+	// that, and a shell's wait would fail with ECHILD.
+	sigemptyset(&default_signals);
+	sigaddset(&default_signals, SIGCHLD);
+	posix_spawnattr_setsigdefault(&attr, &default_signals);
+#ifdef POSIX_SPAWN_SETSID
+	flags |= POSIX_SPAWN_SETSID;
+#else
+	flags |= POSIX_SPAWN_SETPGROUP;
+#endif
+	posix_spawnattr_setflags(&attr, flags);
+	// posix_spawnp()'s prototype is (char *const *) suggesting that it
+	// modifies the contents of the strings.  The prototype is this way due
+	// to SUS maintaining compatability with older code.  However, it is
+	// guaranteed not to modify argv, so the following cast is valid.
+	err = posix_spawnp(&pid, cmd[0], NULL, &attr, (char *const *)cmd, envp);
+	posix_spawnattr_destroy(&attr);
+	free(envp);
+	if (err) {
+		LOG_ERROR("spawn(): %s: %s\n", cmd[0], strerror(err));
+		return -1;
+	}
+	return pid;
 }
 
 // When something we do raises an X error, we get sent here.  There are several
@@ -69,6 +185,7 @@ int handle_xerror(Display *dsply, XErrorEvent *e) {
 	(void)dsply;  // unused
 
 	LOG_ENTER("handle_xerror(error=%d, request=%d/%d, resourceid=%lx)", e->error_code, e->request_code, e->minor_code, e->resourceid);
+	TRACE_SERIAL(TRACE_XERROR, e->resourceid, e->serial, e->error_code, e->request_code);
 
 	// Some parts of the code deliberately disable error checking.
 
@@ -77,6 +194,13 @@ int handle_xerror(Display *dsply, XErrorEvent *e) {
 		LOG_LEAVE();
 		return 0;
 	}
+	for (int i = 0; i < MAX_IGNORED_RANGES; i++) {
+		if (e->serial - display.ignored_ranges[i].first <= display.ignored_ranges[i].last - display.ignored_ranges[i].first) {
+			LOG_DEBUG("ignoring (serial in ignored range)...\n");
+			LOG_LEAVE();
+			return 0;
+		}
+	}
 
 	// client_manage_new() sets initialising to non-None to test if a
 	// window still exists.  If we end up here, the test failed, so
@@ -134,7 +258,10 @@ Bool get_pointer_root_xy(Window w, int *x, int *y) {
 		x = &root_x_r;
 	if (!y)
 		y = &root_y_r;
-	return XQueryPointer(display.dpy, w, &root_r, &child_r, x, y, &win_x_r, &win_y_r, &mask_r);
+	TRACE_BEGIN(TRACE_XQUERYPOINTER, 0);
+	Bool r = XQueryPointer(display.dpy, w, &root_r, &child_r, x, y, &win_x_r, &win_y_r, &mask_r);
+	TRACE_END(TRACE_XQUERYPOINTER);
+	return r;
 }
 
 // Wraps XGetWindowProperty()
@@ -145,10 +272,13 @@ void *get_property(Window w, Atom property, Atom req_type,
 	int actual_format;
 	unsigned long bytes_after;
 	unsigned char *prop;
-	if (XGetWindowProperty(display.dpy, w, property,
-			       0L, MAXIMUM_PROPERTY_LENGTH / 4, False,
-			       req_type, &actual_type, &actual_format,
-			       nitems_return, &bytes_after, &prop) == Success) {
+	TRACE_BEGIN(TRACE_XGETPROPERTY, property);
+	int status = XGetWindowProperty(display.dpy, w, property,
+					0L, MAXIMUM_PROPERTY_LENGTH / 4, False,
+					req_type, &actual_type, &actual_format,
+					nitems_return, &bytes_after, &prop);
+	TRACE_END(TRACE_XGETPROPERTY);
+	if (status == Success) {
 		if (actual_type == req_type)
 			return (void *)prop;
 		XFree(prop);
@@ -173,30 +303,166 @@ int interruptibleXNextEvent(XEvent *event) {
 	int rc;
 	int dpy_fd = ConnectionNumber(display.dpy);
 	for (;;) {
+		struct timeval tv, *timeout = NULL;
+		if (ntimers > 0) {
+			if (run_timers())
+				return 0;
+			unsigned long now = monotonic_ms();
+			long wait = (long)(timers[0].deadline - now);
+			for (int i = 1; i < ntimers; i++) {
+				if ((long)(timers[i].deadline - now) < wait)
+					wait = (long)(timers[i].deadline - now);
+			}
+			if (wait < 0)
+				wait = 0;
+			tv.tv_sec = wait / 1000;
+			tv.tv_usec = (wait % 1000) * 1000;
+			timeout = &tv;
+		}
 		if (XPending(display.dpy)) {
 			XNextEvent(display.dpy, event);
 			return 1;
 		}
+		if (display_process_queued())
+			return 0;
+		int max_fd = dpy_fd;
 		FD_ZERO(&fds);
 		FD_SET(dpy_fd, &fds);
-		rc = select(dpy_fd + 1, &fds, NULL, NULL, NULL);
+		for (int i = 0; i < nwatched_fds; i++) {
+			FD_SET(watched_fds[i].fd, &fds);
+			if (watched_fds[i].fd > max_fd)
+				max_fd = watched_fds[i].fd;
+		}
+		rc = select(max_fd + 1, &fds, NULL, NULL, timeout);
 		if (rc < 0) {
 			if (errno == EINTR) {
 				return 0;
 			} else {
 				LOG_ERROR("interruptibleXNextEvent(): select()\n");
 			}
+		} else {
+			int handled = 0;
+			for (int i = 0; i < nwatched_fds; i++) {
+				if (FD_ISSET(watched_fds[i].fd, &fds)) {
+					watched_fds[i].handler(watched_fds[i].fd);
+					handled = 1;
+				}
+			}
+			if (handled)
+				return 0;
 		}
 	}
 }
 
+// Add or remove file descriptors watched by interruptibleXNextEvent()
+
+void watch_fd(int fd, void (*handler)(int fd)) {
+	if (nwatched_fds >= watched_fds_size) {
+		watched_fds_size += 4;
+		watched_fds = xrealloc(watched_fds, watched_fds_size * sizeof(*watched_fds));
+	}
+	watched_fds[nwatched_fds].fd = fd;
+	watched_fds[nwatched_fds].handler = handler;
+	nwatched_fds++;
+}
+
+void unwatch_fd(int fd) {
+	for (int i = 0; i < nwatched_fds; i++) {
+		if (watched_fds[i].fd == fd) {
+			watched_fds[i] = watched_fds[--nwatched_fds];
+			return;
+		}
+	}
+}
+
+// Milliseconds on the monotonic clock
+
+unsigned long monotonic_ms(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (unsigned long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+// Schedule or cancel a one-shot timer.  A handler has at most one pending
+// timer: setting it again reschedules it.
+
+void set_timer(unsigned ms, void (*handler)(void)) {
+	unsigned long deadline = monotonic_ms() + ms;
+	for (int i = 0; i < ntimers; i++) {
+		if (timers[i].handler == handler) {
+			timers[i].deadline = deadline;
+			return;
+		}
+	}
+	if (ntimers >= MAX_TIMERS) {
+		LOG_ERROR("set_timer(): too many timers\n");
+		return;
+	}
+	timers[ntimers].deadline = deadline;
+	timers[ntimers].handler = handler;
+	ntimers++;
+}
+
+void cancel_timer(void (*handler)(void)) {
+	for (int i = 0; i < ntimers; i++) {
+		if (timers[i].handler == handler) {
+			timers[i] = timers[--ntimers];
+			return;
+		}
+	}
+}
+
+// Call the handlers of any expired timers.  Returns non-zero if any were
+// called.  Handlers may set or cancel timers.
+
+int run_timers(void) {
+	unsigned long now = monotonic_ms();
+	void (*expired[MAX_TIMERS])(void);
+	int nexpired = 0;
+	// Collect first, so that a handler rescheduling itself isn't run again
+	// until its new deadline.
+	for (int i = 0; i < ntimers; ) {
+		if ((long)(timers[i].deadline - now) <= 0) {
+			expired[nexpired++] = timers[i].handler;
+			timers[i] = timers[--ntimers];
+		} else {
+			i++;
+		}
+	}
+	for (int i = 0; i < nexpired; i++)
+		expired[i]();
+	return nexpired > 0;
+}
+
+// Ignore errors for requests with serials in the given (inclusive) range.  A
+// fixed number of ranges are remembered, oldest overwritten first.
+
+void ignore_xerrors(unsigned long first, unsigned long last) {
+	if (last - first > (unsigned long)LONG_MAX)
+		return;
+	unsigned i = display.next_ignored_range;
+	display.ignored_ranges[i].first = first;
+	display.ignored_ranges[i].last = last;
+	display.next_ignored_range = (i + 1) % MAX_IGNORED_RANGES;
+}
+
 // Remove enter events from the queue, preserving only the last one
 // corresponding to "except"s parent.
+//
+// In remote mode, avoid the round trip: note the next request serial, and
+// have handle_enter_event() skip enter events generated before it.
 
 void discard_enter_events(struct client *except) {
 	XEvent tmp, putback_ev;
 	int putback = 0;
+	if (option.remote) {
+		display.discard_enter_serial = NextRequest(display.dpy);
+		display.discard_enter_except = except->parent;
+		return;
+	}
+	TRACE_BEGIN(TRACE_XSYNC, 0);
 	XSync(display.dpy, False);
+	TRACE_END(TRACE_XSYNC);
 	while (XCheckMaskEvent(display.dpy, EnterWindowMask, &tmp)) {
 		if (tmp.xcrossing.window == except->parent) {
 			memcpy(&putback_ev, &tmp, sizeof(XEvent));
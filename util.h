@@ -5,9 +5,13 @@
 #ifndef EVILWM_UTIL_H_
 #define EVILWM_UTIL_H_
 
+#include <sys/types.h>
+
 #include <X11/X.h>
 #include <X11/Xdefs.h>
 
+#include "stats.h"
+
 // Required for interpreting MWM hints
 
 #define PROP_MWM_HINTS_ELEMENTS 3
@@ -35,6 +39,11 @@ typedef struct {
 		      GrabModeAsync, GrabModeAsync, \
 		      None, curs, CurrentTime) == GrabSuccess)
 
+// Grab and release the server, accounting for time spent grabbed.
+
+#define grab_server() do { XGrabServer(display.dpy); STATS_GRAB(); } while (0)
+#define ungrab_server() do { XUngrabServer(display.dpy); STATS_UNGRAB(); } while (0)
+
 // Move the mouse pointer.
 
 #define setmouse(w, x, y) XWarpPointer(display.dpy, None, w, 0, 0, 0, 0, x, y)
@@ -43,8 +52,14 @@ typedef struct {
 extern int ignore_xerror;
 extern volatile Window initialising;
 
-// Spawn a subprocess (usually xterm or similar)
-void spawn(const char *const cmd[]);
+// Ignore errors for requests with serials in the given (inclusive) range.
+void ignore_xerrors(unsigned long first, unsigned long last);
+
+// Set up reaping of spawned subprocesses.
+void spawn_init(void);
+
+// Spawn a subprocess (usually xterm or similar).  Returns its PID, or -1.
+pid_t spawn(const char *const cmd[]);
 
 // Global X11 error handler.  Various actions interact with this.
 int handle_xerror(Display *dsply, XErrorEvent *e);
@@ -56,9 +71,28 @@ Bool get_pointer_root_xy(Window w, int *x, int *y); // Wraps XQueryPointer()
 void *get_property(Window w, Atom property, Atom req_type, unsigned long *nitems_return);
 
 // Alternative to XNextEvent().  Unlike XNextEvent, if a signal arrives,
-// interruptibleXNextEvent will return zero.
+// interruptibleXNextEvent will return zero.  It also returns zero after
+// calling the handler for any watched file descriptor that became readable, or
+// handling events already queued for another display.
 int interruptibleXNextEvent(XEvent *event);
 
+// Watch an additional file descriptor from interruptibleXNextEvent().  The
+// handler is called from the main thread whenever fd is readable.
+void watch_fd(int fd, void (*handler)(int fd));
+void unwatch_fd(int fd);
+
+// Milliseconds on the monotonic clock.
+unsigned long monotonic_ms(void);
+
+// One-shot timers, run from interruptibleXNextEvent().  A handler has at most
+// one pending timer: setting it again reschedules it.
+void set_timer(unsigned ms, void (*handler)(void));
+void cancel_timer(void (*handler)(void));
+
+// Call the handlers of any expired timers.  Returns non-zero if any were
+// called.
+int run_timers(void);
+
 // Remove enter events from the queue, preserving only the last one
 // corresponding to "except"s parent.
 void discard_enter_events(struct client *except);
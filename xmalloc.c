@@ -14,10 +14,12 @@ Copyright 2014-2018 Ciaran Anscomb
 #include <stdio.h>
 #include <string.h>
 
+#include "stats.h"
 #include "xalloc.h"
 
 void *xmalloc(size_t s) {
 	void *mem = malloc(s);
+	STATS_ALLOC(s);
 	if (!mem) {
 		perror(NULL);
 		exit(EXIT_FAILURE);
@@ -33,6 +35,7 @@ void *xzalloc(size_t s) {
 
 void *xrealloc(void *p, size_t s) {
 	void *mem = realloc(p, s);
+	STATS_ALLOC(s);
 	if (!mem && s != 0) {
 		perror(NULL);
 		exit(EXIT_FAILURE);